@@ -0,0 +1,143 @@
+/*
+    AudioEngine.hpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Renders a chaotic oscillator as stereo audio (x left, y right) from inside
+    an audio driver's callback, the way a VCV Rack module's process() runs
+    on the engine thread. The callback path allocates nothing, takes no locks
+    and makes no system calls: every buffer is allocated up front, control
+    values arrive through atomics and are smoothed, and timing
+    results leave through a wait-free ring. (steady_clock reads the vDSO
+    clock on Linux without entering the kernel.)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "ChaoticOscillator.hpp"
+#include "SpscRing.hpp"
+
+namespace Analog
+{
+    // How long one callback took, and how long it had.
+    struct AudioCallbackTiming
+    {
+        unsigned frames = 0;
+        double seconds = 0.0;
+        double budget = 0.0;        // frames / sample rate
+    };
+
+
+    class AudioEngine
+    {
+    private:
+        std::unique_ptr<ChaoticOscillator> osc;
+        const double sampleRate;
+        const std::size_t capacity;             // frames rendered per oscillator call
+        std::vector<float> bx;
+        std::vector<float> by;
+        std::vector<float> knobIn;
+        std::atomic<float> knobTarget{0.0f};
+        std::atomic<float> speedTarget{1.0f};
+        std::atomic<float> gainTarget{1.0f};
+        double knob = 0.0;                      // smoothed values, audio thread only
+        double speed = 1.0;
+        double gain = 1.0;
+        const double smoothing;                 // one-pole coefficient per sample
+        SpscRing<AudioCallbackTiming> timings{1024};
+
+        // Move a smoothed value one step toward its target, snapping to the target
+        // once close enough, so that a steady knob stops paying for per-sample modulation.
+        static void approach(double& value, double target, double coefficient)
+        {
+            const double diff = target - value;
+            if (std::abs(diff) < 1.0e-6)
+                value = target;
+            else
+                value += coefficient * diff;
+        }
+
+    public:
+        // `maxFrames` is the largest block rendered in one oscillator call;
+        // longer callbacks are rendered in several pieces.
+        AudioEngine(std::unique_ptr<ChaoticOscillator> oscillator, double rate, std::size_t maxFrames = 1024, double smoothingSeconds = 0.01)
+            : osc(std::move(oscillator))
+            , sampleRate(rate)
+            , capacity(std::max<std::size_t>(maxFrames, 1))
+            , bx(capacity)
+            , by(capacity)
+            , knobIn(capacity)
+            , knob(osc->getKnob())
+            , smoothing(1.0 - std::exp(-1.0 / (smoothingSeconds * rate)))
+        {
+            knobTarget.store(static_cast<float>(knob));
+        }
+
+        AudioEngine(const AudioEngine&) = delete;
+        AudioEngine& operator=(const AudioEngine&) = delete;
+
+        // Control thread: the new values are reached smoothly over about 10 ms.
+        void setKnob(double k) { knobTarget.store(static_cast<float>(k), std::memory_order_relaxed); }
+        void setSpeed(double s) { speedTarget.store(static_cast<float>(s), std::memory_order_relaxed); }
+        void setGain(double g) { gainTarget.store(static_cast<float>(g), std::memory_order_relaxed); }
+
+        // Control thread: pass the timing of every callback since the last call to `consume(timing)`.
+        template <typename consume_t>
+        std::size_t drainTimings(consume_t consume)
+        {
+            return timings.drain(consume);
+        }
+
+        // Audio thread: fill `frames` interleaved stereo float frames.
+        void render(float *out, std::size_t frames)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const double targetKnob = knobTarget.load(std::memory_order_relaxed);
+            const double targetSpeed = speedTarget.load(std::memory_order_relaxed);
+            const double targetGain = gainTarget.load(std::memory_order_relaxed);
+
+            for (std::size_t done = 0; done < frames; )
+            {
+                const std::size_t n = std::min(capacity, frames - done);
+
+                // The speed scales the time step, so it is smoothed per block;
+                // the knob is smoothed per sample while it is moving.
+                approach(speed, targetSpeed, 1.0 - std::pow(1.0 - smoothing, static_cast<double>(n)));
+                const double dt = speed / sampleRate;
+                if (knob == targetKnob)
+                {
+                    osc->process(bx.data(), by.data(), nullptr, n, dt);
+                }
+                else
+                {
+                    for (std::size_t f = 0; f < n; ++f)
+                    {
+                        approach(knob, targetKnob, smoothing);
+                        knobIn[f] = static_cast<float>(knob);
+                    }
+                    osc->process(bx.data(), by.data(), nullptr, knobIn.data(), n, dt);
+                }
+
+                // Scale the +/-AMPLITUDE outputs to +/-1 full scale.
+                for (std::size_t f = 0; f < n; ++f)
+                {
+                    approach(gain, targetGain, smoothing);
+                    const float g = static_cast<float>(gain / AMPLITUDE);
+                    out[2*(done+f) + 0] = g * bx[f];
+                    out[2*(done+f) + 1] = g * by[f];
+                }
+                done += n;
+            }
+
+            AudioCallbackTiming t;
+            t.frames = static_cast<unsigned>(frames);
+            t.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            t.budget = frames / sampleRate;
+            timings.push(t);        // dropped if nobody is reading
+        }
+    };
+}
@@ -0,0 +1,180 @@
+/*
+    BasicOscillator.hpp  -  Don Cross <cosinekitty@gmail.com>
+
+    A statically dispatched alternative to the virtual ChaoticOscillator class.
+    BasicOscillator<model_t> has the same interface as ChaoticOscillator,
+    but it calls the model's slope formula directly, so the compiler can
+    inline the whole integration step into the sample loop.
+    The integration scheme is a policy from Integrators.hpp (midpoint by default).
+    Use AnyOscillator (see MakeChaoticOscillator.hpp) to select a model at run time.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include "ChaoticOscillator.hpp"
+
+namespace Analog
+{
+    template <typename model_t, typename integrator_t = MidpointIntegrator>
+    class BasicOscillator
+    {
+    private:
+        double knob = 0.0;
+        double coeff = model_t::coefficient(0.0);     // model coefficient derived from the knob
+
+        double x1{};
+        double y1{};
+        double z1{};
+
+        AdaptiveState adaptive;
+        DenseOutput dense;
+
+        void step(double dt)
+        {
+            integrator_t::step(x1, y1, z1, dt, ModelSlopes<model_t>{coeff});
+        }
+
+        int advance(double dt, int n)
+        {
+            // Returns the number of integration steps taken.
+            if (adaptive.tolerance > 0.0)
+                return AdaptiveAdvance(adaptive, x1, y1, z1, dt, integrator_t::template maxStep<model_t>(), ModelSlopes<model_t>{coeff});
+
+            const double et = dt / n;
+            for (int i = 0; i < n; ++i)
+                step(et);
+            return n;
+        }
+
+        // The same stepping as ChaoticOscillator::render(), without the instrumentation or range table.
+        template <typename sample_t>
+        void render(sample_t *outX, sample_t *outY, sample_t *outZ, const sample_t *knobIn, std::size_t frames, double dt)
+        {
+            dense.reset();
+            const int n = oversampling(dt);
+            const double et = dt / n;
+            const OutputRemap remap(model_t::xmin, model_t::xmax, model_t::ymin, model_t::ymax, model_t::zmin, model_t::zmax);
+            for (std::size_t f = 0; f < frames; ++f)
+            {
+                if (knobIn)
+                {
+                    ModulatedSample(coeff, knobIn[f], adaptive.tolerance > 0.0, n, et,
+                        [this](double k) { setKnob(k); },
+                        [this](double h) { step(h); },
+                        [this, dt, n]() { return advance(dt, n); });
+                }
+                else
+                {
+                    advance(dt, n);
+                }
+                remap.store(outX, outY, outZ, f, x1, y1, z1);
+            }
+        }
+
+        template <typename sample_t>
+        void renderDense(sample_t *outX, sample_t *outY, sample_t *outZ, std::size_t frames, double interval)
+        {
+            const double h = (integrator_t::template maxStep<model_t>() > 0.0) ? integrator_t::template maxStep<model_t>() : interval;
+            const OutputRemap remap(model_t::xmin, model_t::xmax, model_t::ymin, model_t::ymax, model_t::zmin, model_t::zmax);
+            const ModelSlopes<model_t> slopes{coeff};
+            double ox, oy, oz;
+            for (std::size_t f = 0; f < frames; ++f)
+            {
+                DenseAdvance(dense, x1, y1, z1, interval, h,
+                    [&slopes](double& x, double& y, double& z, double h) { integrator_t::step(x, y, z, h, slopes); },
+                    slopes,
+                    ox, oy, oz);
+                remap.store(outX, outY, outZ, f, ox, oy, oz);
+            }
+        }
+
+    public:
+        static constexpr bool isTuned = true;
+
+        BasicOscillator()
+        {
+            initialize();
+        }
+
+        bool hasStabilityProtection() const { return integrator_t::template maxStep<model_t>() > 0.0; }
+
+        void initialize()
+        {
+            x1 = model_t::x0;
+            y1 = model_t::y0;
+            z1 = model_t::z0;
+            adaptive.reset();
+            dense.reset();
+        }
+
+        void setKnob(double k)
+        {
+            // Enforce keeping the knob in the range [-1, 1].
+            knob = std::max(-1.0, std::min(+1.0, k));
+            coeff = model_t::coefficient(knob);
+            adaptive.haveSlope = false;
+        }
+
+        void setTolerance(double tolerance)
+        {
+            adaptive.tolerance = std::max(0.0, tolerance);
+            adaptive.reset();
+        }
+
+        double tolerance() const { return adaptive.tolerance; }
+
+        // Scaled values...
+        double vx() const { return Remap(x1, model_t::xmin, model_t::xmax); }
+        double vy() const { return Remap(y1, model_t::ymin, model_t::ymax); }
+        double vz() const { return Remap(z1, model_t::zmin, model_t::zmax); }
+
+        // Raw values...
+        double rx() const { return x1; }
+        double ry() const { return y1; }
+        double rz() const { return z1; }
+
+        int oversampling(double dt) const
+        {
+            return OversampleCount(dt, integrator_t::template maxStep<model_t>());
+        }
+
+        void update(double dt)
+        {
+            dense.reset();
+            advance(dt, oversampling(dt));
+        }
+
+        void process(float *outX, float *outY, float *outZ, std::size_t frames, double dt)
+        {
+            render<float>(outX, outY, outZ, nullptr, frames, dt);
+        }
+
+        void process(double *outX, double *outY, double *outZ, std::size_t frames, double dt)
+        {
+            render<double>(outX, outY, outZ, nullptr, frames, dt);
+        }
+
+        void process(float *outX, float *outY, float *outZ, const float *knobIn, std::size_t frames, double dt)
+        {
+            render(outX, outY, outZ, knobIn, frames, dt);
+        }
+
+        void process(double *outX, double *outY, double *outZ, const double *knobIn, std::size_t frames, double dt)
+        {
+            render(outX, outY, outZ, knobIn, frames, dt);
+        }
+
+        // Dense output: see ChaoticOscillator::processDense().
+        void processDense(float *outX, float *outY, float *outZ, std::size_t frames, double interval)
+        {
+            renderDense(outX, outY, outZ, frames, interval);
+        }
+
+        void processDense(double *outX, double *outY, double *outZ, std::size_t frames, double interval)
+        {
+            renderDense(outX, outY, outZ, frames, interval);
+        }
+    };
+}
@@ -1,6 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstddef>
+#include "Integrators.hpp"
+#include "RangeTable.hpp"
+
+// Build with -DANALOG_INSTRUMENT=1 to count the work each ChaoticOscillator does
+// (see OscillatorCounters). Otherwise the counting compiles to nothing.
+#ifndef ANALOG_INSTRUMENT
+#define ANALOG_INSTRUMENT 0
+#endif
 
 namespace Analog
 {
@@ -19,6 +30,53 @@ namespace Analog
     }
 
 
+    struct LinearRemap
+    {
+        // The same mapping as Remap(v, vmin, vmax), but with the division
+        // folded into a scale and offset so it can be hoisted out of a loop.
+        double scale = 1.0;
+        double offset = 0.0;
+
+        LinearRemap(double vmin, double vmax)
+        {
+            if (vmax > vmin)
+            {
+                scale = (2 * AMPLITUDE) / (vmax - vmin);
+                offset = -AMPLITUDE * (vmax + vmin) / (vmax - vmin);
+            }
+        }
+
+        double operator() (double v) const
+        {
+            return scale*v + offset;
+        }
+    };
+
+
+    struct OutputRemap
+    {
+        // The LinearRemap of all three channels, for block rendering.
+        LinearRemap mx;
+        LinearRemap my;
+        LinearRemap mz;
+
+        OutputRemap(double xmin, double xmax, double ymin, double ymax, double zmin, double zmax)
+            : mx(xmin, xmax)
+            , my(ymin, ymax)
+            , mz(zmin, zmax)
+            {}
+
+        // Stores the scaled state as sample f of each output buffer that is not null.
+        template <typename sample_t>
+        void store(sample_t *outX, sample_t *outY, sample_t *outZ, std::size_t f, double x, double y, double z) const
+        {
+            if (outX) outX[f] = static_cast<sample_t>(mx(x));
+            if (outY) outY[f] = static_cast<sample_t>(my(y));
+            if (outZ) outZ[f] = static_cast<sample_t>(mz(z));
+        }
+    };
+
+
     struct SlopeVector
     {
         double mx;
@@ -41,51 +99,256 @@ namespace Analog
     }
 
 
+    inline int OversampleCount(double dt, double max_dt)
+    {
+        // If there is a known maximum stable time increment,
+        // use oversampling to keep the actual time increment within that limit:
+        // find the smallest positive integer n such that dt/n <= max_dt.
+        return (max_dt <= 0.0) ? 1 : static_cast<int>(std::ceil(dt / max_dt));
+    }
+
+
+    // Advances one sample of block rendering with knob modulation, for both
+    // ChaoticOscillator and BasicOscillator. `setKnob(k)` must update `coeff`,
+    // `step(et)` takes one fixed substep, and `advance()` integrates the whole
+    // sample adaptively and returns the number of steps it took.
+    // Returns the number of integration steps taken, leaving `coeff` at its value for knob `k`.
+    template <typename set_knob_t, typename step_t, typename advance_t>
+    inline int ModulatedSample(double& coeff, double k, bool adaptive, int n, double et, set_knob_t setKnob, step_t step, advance_t advance)
+    {
+        const double c0 = coeff;
+        setKnob(k);
+        const double c1 = coeff;
+        int steps = n;
+        if (adaptive)
+        {
+            // The adaptive integrator chooses its own substeps,
+            // so hold the coefficient at its mean value over the sample.
+            coeff = (c0 + c1) / 2;
+            steps = advance();
+        }
+        else
+        {
+            // Sweep the coefficient linearly from its previous value to the value
+            // for this sample's knob, evaluating it at the center of each substep.
+            const double dc = (c1 - c0) / n;
+            for (int i = 0; i < n; ++i)
+            {
+                coeff = c0 + (i + 0.5)*dc;
+                step(et);
+            }
+        }
+        coeff = c1;
+        return steps;
+    }
+
+
+    // Everything needed to resume a ChaoticOscillator where it left off:
+    // its raw state and its knob. See saveState() and restoreState().
+    struct OscillatorState
+    {
+        double x = 0.0;
+        double y = 0.0;
+        double z = 0.0;
+        double knob = 0.0;
+    };
+
+
+    constexpr bool INSTRUMENTED = (ANALOG_INSTRUMENT != 0);
+
+    struct OscillatorCounters
+    {
+        long samples = 0;               // samples produced by update(), process() or processDense()
+        long substeps = 0;              // integration steps taken (attempted, in adaptive mode)
+        long slopeCalls = 0;            // evaluations of the slope formula
+        int maxSubsteps = 0;            // most integration steps taken for one sample
+        long outOfBounds = 0;           // samples with a scaled output beyond AMPLITUDE
+        long blocks = 0;                // calls to process() or processDense()
+        double blockSeconds = 0.0;      // wall time spent in those calls
+        double maxBlockSeconds = 0.0;   // longest of those calls
+
+        double substepsPerSample() const { return (samples > 0) ? static_cast<double>(substeps) / samples : 0.0; }
+        double slopeCallsPerSample() const { return (samples > 0) ? static_cast<double>(slopeCalls) / samples : 0.0; }
+        double secondsPerBlock() const { return (blocks > 0) ? blockSeconds / blocks : 0.0; }
+    };
+
+
     class ChaoticOscillator
     {
     protected:
         double max_dt = 0.0;
         double knob = 0.0;
+        double coeff = 0.0;     // knob-dependent coefficient, see coefficient()
 
         virtual SlopeVector slopes(double x, double y, double z) const = 0;
 
-    private:
-        const int max_iter = 2;
+        // A derived class whose slopes depend on the knob can convert the knob
+        // into a coefficient here. The result is cached in `coeff` whenever the knob
+        // changes, so slopes() can read it instead of converting on every call.
+        virtual double coefficient(double) const { return 0.0; }
 
+        // Advances the state (x, y, z) by one fixed time step `dt`.
+        // The default is the midpoint scheme calling slopes().
+        // ModelOscillator overrides this to inline its model and integrator policy.
+        virtual void integrate(double& x, double& y, double& z, double dt) const
+        {
+            MidpointStep(x, y, z, dt, [this](double& mx, double& my, double& mz, double px, double py, double pz)
+            {
+                evaluate(mx, my, mz, px, py, pz);
+            });
+        }
+
+        // For overrides of integrate() that compute slopes without calling slopes().
+        void countSlopeCalls(int n) const
+        {
+            if constexpr (INSTRUMENTED)
+                counters.slopeCalls += n;
+        }
+
+    private:
         const double x0;
         const double y0;
         const double z0;
 
-        const double xmin;
-        const double xmax;
-        const double ymin;
-        const double ymax;
-        const double zmin;
-        const double zmax;
+        // Raw output ranges, remapped to [-AMPLITUDE, +AMPLITUDE].
+        // They follow the knob when a range table is loaded.
+        double xmin;
+        double xmax;
+        double ymin;
+        double ymax;
+        double zmin;
+        double zmax;
+        RangeTable ranges;
 
         double x1{};
         double y1{};
         double z1{};
 
+        AdaptiveState adaptive;
+        DenseOutput dense;
+        mutable OscillatorCounters counters;
+
+        void evaluate(double& mx, double& my, double& mz, double x, double y, double z) const
+        {
+            countSlopeCalls(1);
+            SlopeVector s = slopes(x, y, z);
+            mx = s.mx;
+            my = s.my;
+            mz = s.mz;
+        }
+
         void step(double dt)
         {
-            SlopeVector s = slopes(x1, y1, z1);
-            double dx = dt * s.mx;
-            double dy = dt * s.my;
-            double dz = dt * s.mz;
-            for (int iter = 0; iter < max_iter; ++iter)
+            integrate(x1, y1, z1, dt);
+        }
+
+        void applyRanges()
+        {
+            const RangeRow r = ranges.lookup(knob);
+            xmin = r.xmin;
+            xmax = r.xmax;
+            ymin = r.ymin;
+            ymax = r.ymax;
+            zmin = r.zmin;
+            zmax = r.zmax;
+        }
+
+        int advance(double dt, int n)
+        {
+            // Returns the number of integration steps taken.
+            if (adaptive.tolerance > 0.0)
+            {
+                return AdaptiveAdvance(adaptive, x1, y1, z1, dt, max_dt, [this](double& mx, double& my, double& mz, double x, double y, double z)
+                {
+                    evaluate(mx, my, mz, x, y, z);
+                });
+            }
+
+            const double et = dt / n;
+            for (int i = 0; i < n; ++i)
+                step(et);
+            return n;
+        }
+
+        void countSample(int steps, double vx, double vy, double vz)
+        {
+            if constexpr (INSTRUMENTED)
+            {
+                ++counters.samples;
+                counters.substeps += steps;
+                counters.maxSubsteps = std::max(counters.maxSubsteps, steps);
+                if (isTuned && std::max({std::abs(vx), std::abs(vy), std::abs(vz)}) > AMPLITUDE)
+                    ++counters.outOfBounds;
+            }
+        }
+
+        std::chrono::steady_clock::time_point blockStart() const
+        {
+            if constexpr (INSTRUMENTED)
+                return std::chrono::steady_clock::now();
+            else
+                return {};
+        }
+
+        void blockFinish(std::chrono::steady_clock::time_point start)
+        {
+            if constexpr (INSTRUMENTED)
+            {
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                ++counters.blocks;
+                counters.blockSeconds += seconds;
+                counters.maxBlockSeconds = std::max(counters.maxBlockSeconds, seconds);
+            }
+        }
+
+        template <typename sample_t>
+        void render(sample_t *outX, sample_t *outY, sample_t *outZ, const sample_t *knobIn, std::size_t frames, double dt)
+        {
+            const auto start = blockStart();
+            dense.reset();
+            const int n = oversampling(dt);
+            const double et = dt / n;
+            OutputRemap remap(xmin, xmax, ymin, ymax, zmin, zmax);
+            for (std::size_t f = 0; f < frames; ++f)
+            {
+                int steps;
+                if (knobIn)
+                {
+                    steps = ModulatedSample(coeff, knobIn[f], adaptive.tolerance > 0.0, n, et,
+                        [this](double k) { setKnob(k); },
+                        [this](double h) { step(h); },
+                        [this, dt, n]() { return advance(dt, n); });
+                    if (!ranges.empty())
+                        remap = OutputRemap(xmin, xmax, ymin, ymax, zmin, zmax);
+                }
+                else
+                {
+                    steps = advance(dt, n);
+                }
+                remap.store(outX, outY, outZ, f, x1, y1, z1);
+                countSample(steps, remap.mx(x1), remap.my(y1), remap.mz(z1));
+            }
+            blockFinish(start);
+        }
+
+        template <typename sample_t>
+        void renderDense(sample_t *outX, sample_t *outY, sample_t *outZ, std::size_t frames, double interval)
+        {
+            const auto start = blockStart();
+            const double h = (max_dt > 0.0) ? max_dt : interval;
+            const OutputRemap remap(xmin, xmax, ymin, ymax, zmin, zmax);
+            double ox, oy, oz;
+            for (std::size_t f = 0; f < frames; ++f)
             {
-                double xm = x1 + dx/2;
-                double ym = y1 + dy/2;
-                double zm = z1 + dz/2;
-                s = slopes(xm, ym, zm);
-                dx = dt * s.mx;
-                dy = dt * s.my;
-                dz = dt * s.mz;
+                int steps = 0;
+                DenseAdvance(dense, x1, y1, z1, interval, h,
+                    [this, &steps](double& x, double& y, double& z, double h) { ++steps; integrate(x, y, z, h); },
+                    [this](double& mx, double& my, double& mz, double x, double y, double z) { evaluate(mx, my, mz, x, y, z); },
+                    ox, oy, oz);
+                remap.store(outX, outY, outZ, f, ox, oy, oz);
+                countSample(steps, remap.mx(ox), remap.my(oy), remap.mz(oz));
             }
-            x1 += dx;
-            y1 += dy;
-            z1 += dz;
+            blockFinish(start);
         }
 
     public:
@@ -136,14 +399,83 @@ namespace Analog
             x1 = x0;
             y1 = y0;
             z1 = z0;
+            adaptive.reset();
+            dense.reset();
+        }
+
+        // Start from an arbitrary raw state instead of the initial conditions.
+        void setState(double x, double y, double z)
+        {
+            x1 = x;
+            y1 = y;
+            z1 = z;
+            adaptive.reset();
+            dense.reset();
+        }
+
+        OscillatorState saveState() const
+        {
+            OscillatorState s;
+            s.x = x1;
+            s.y = y1;
+            s.z = z1;
+            s.knob = knob;
+            return s;
+        }
+
+        void restoreState(const OscillatorState& s)
+        {
+            setKnob(s.knob);
+            setState(s.x, s.y, s.z);
         }
 
+        double getKnob() const { return knob; }
+
         void setKnob(double k)
         {
             // Enforce keeping the knob in the range [-1, 1].
             knob = std::max(-1.0, std::min(+1.0, k));
+            coeff = coefficient(knob);
+            adaptive.haveSlope = false;
+            if (!ranges.empty())
+                applyRanges();
+        }
+
+        // Replace the fixed output ranges with ranges calibrated across the knob
+        // (see RangeTable.hpp and the calibrate tool), and the maximum time step
+        // with the one found by the stepsearch tool. Whatever the table lacks is unchanged.
+        void setRangeTable(const RangeTable& table)
+        {
+            if (!table.empty())
+            {
+                ranges = table;
+                applyRanges();
+            }
+            if (table.maxStep > 0.0)
+                setMaxStep(table.maxStep);
+        }
+
+        // Override the maximum stable time increment. Zero disables oversampling.
+        void setMaxStep(double dt)
+        {
+            max_dt = std::max(0.0, dt);
+            adaptive.reset();
+        }
+
+        double maxStep() const { return max_dt; }
+
+        bool hasRangeTable() const { return !ranges.empty(); }
+
+        // A positive tolerance selects adaptive step size control instead of
+        // fixed oversampling: see AdaptiveAdvance. Zero restores fixed oversampling.
+        void setTolerance(double tolerance)
+        {
+            adaptive.tolerance = std::max(0.0, tolerance);
+            adaptive.reset();
         }
 
+        double tolerance() const { return adaptive.tolerance; }
+
         // Scaled values...
         double vx() const { return Remap(x1, xmin, xmax); }
         double vy() const { return Remap(y1, ymin, ymax); }
@@ -154,139 +486,337 @@ namespace Analog
         double ry() const { return y1; }
         double rz() const { return z1; }
 
+        int oversampling(double dt) const
+        {
+            return OversampleCount(dt, max_dt);
+        }
+
         void update(double dt)
         {
-            // If the derived class has informed us of a maximum stable time increment,
-            // use oversampling to keep the actual time increment within that limit:
-            // find the smallest positive integer n such that dt/n <= max_dt.
-            const int n = (max_dt <= 0.0) ? 1 : static_cast<int>(std::ceil(dt / max_dt));
-            const double et = dt / n;
-            for (int i = 0; i < n; ++i)
-                step(et);
+            dense.reset();
+            const int steps = advance(dt, oversampling(dt));
+            countSample(steps, vx(), vy(), vz());
+        }
+
+        // Instrumentation: a snapshot of the counters accumulated since the last reset.
+        // Always zero unless built with ANALOG_INSTRUMENT=1.
+        OscillatorCounters snapshotCounters() const { return counters; }
+        void resetCounters() { counters = OscillatorCounters{}; }
+
+        // Block rendering: advance `frames` samples of `dt` seconds each,
+        // writing the scaled values vx, vy, vz of every sample to the output buffers.
+        // Any output pointer may be null to skip that channel.
+        void process(float *outX, float *outY, float *outZ, std::size_t frames, double dt)
+        {
+            render<float>(outX, outY, outZ, nullptr, frames, dt);
+        }
+
+        void process(double *outX, double *outY, double *outZ, std::size_t frames, double dt)
+        {
+            render<double>(outX, outY, outZ, nullptr, frames, dt);
+        }
+
+        // Block rendering with audio-rate knob modulation: knobIn[f] is the knob value
+        // for sample f, interpolated across the oversampled substeps of that sample.
+        // After the call the knob is left at knobIn[frames-1].
+        void process(float *outX, float *outY, float *outZ, const float *knobIn, std::size_t frames, double dt)
+        {
+            render(outX, outY, outZ, knobIn, frames, dt);
+        }
+
+        void process(double *outX, double *outY, double *outZ, const double *knobIn, std::size_t frames, double dt)
+        {
+            render(outX, outY, outZ, knobIn, frames, dt);
+        }
+
+        // Dense output: produce `frames` scaled samples spaced `interval` seconds apart,
+        // integrating with internal steps of max_dt regardless of the interval and
+        // interpolating each output within its step (see DenseAdvance).
+        // This pays only for the steps the integrator needs, so it is much cheaper than
+        // process() whenever the interval is shorter than max_dt or only a few outputs are needed.
+        // Afterward vx(), rx(), etc. report the internal state, up to one step ahead of the output.
+        // Calling update() or process() discards the interpolation step and continues from that state.
+        void processDense(float *outX, float *outY, float *outZ, std::size_t frames, double interval)
+        {
+            renderDense(outX, outY, outZ, frames, interval);
+        }
+
+        void processDense(double *outX, double *outY, double *outZ, std::size_t frames, double interval)
+        {
+            renderDense(outX, outY, outZ, frames, interval);
         }
     };
 
 
-    class Rucklidge : public ChaoticOscillator     // http://www.3d-meier.de/tut19/Seite17.html
+    template <typename real_t>
+    inline void Fill(real_t& r, double value)
     {
-    private:
-        const double k = 2.0;
-        const double a1 = 3.8;      // minimum value of `a`: simple non-chaotic double loop
-        const double a2 = 6.7;      // maximum value of `a`: stable but chaotic
+        // Sets a double, or every lane of a SIMD lane vector, to a constant.
+        r = real_t{} + value;
+    }
 
-    protected:
-        SlopeVector slopes(double x, double y, double z) const override
+
+    // Each model below is a stateless description of one chaotic system:
+    // its constants, initial conditions, measured output ranges, maximum
+    // stable time increment, and the right-hand side of its differential equations.
+    // The right-hand side is a template so that the same formula can be evaluated
+    // on a single double or on a SIMD lane vector (see OscillatorBank.hpp).
+    // The analytic Jacobian of the right-hand side is provided for implicit integrators.
+    // The knob is converted to a model-specific coefficient `c` before the
+    // slopes are evaluated; models without a knob ignore it.
+    // Each model has a maximum time increment for every integrator policy
+    // (max_dt for midpoint, max_dt_heun, and so on; see Integrators.hpp).
+    // The midpoint value keeps the original calibration; the others were
+    // measured to give the same accuracy.
+
+    struct RucklidgeModel     // http://www.3d-meier.de/tut19/Seite17.html
+    {
+        static constexpr double k = 2.0;
+        static constexpr double a1 = 3.8;      // minimum value of `a`: simple non-chaotic double loop
+        static constexpr double a2 = 6.7;      // maximum value of `a`: stable but chaotic
+
+        static constexpr double x0 = 0.788174;
+        static constexpr double y0 = 0.522280;
+        static constexpr double z0 = 1.250344;
+
+        static constexpr double xmin = -10.15;
+        static constexpr double xmax = +10.17;
+        static constexpr double ymin =  -5.570;
+        static constexpr double ymax =  +5.565;
+        static constexpr double zmin =   0.000;
+        static constexpr double zmax = +15.387;
+
+        static constexpr double max_dt = 0.001;
+        static constexpr double max_dt_heun = 0.0007;
+        static constexpr double max_dt_ralston = 0.00069;
+        static constexpr double max_dt_rk4 = 0.034;
+        static constexpr double max_dt_trapezoid = 0.00094;
+
+        static double coefficient(double knob)
         {
-            const double a = KnobValue(knob, a1, a2);
-            return SlopeVector (
-                -k*x + a*y - y*z,
-                x,
-                -z + y*y
-            );
+            return KnobValue(knob, a1, a2);
         }
 
-    public:
-        Rucklidge()
-            : ChaoticOscillator(
-                0.788174, 0.522280, 1.250344,
-                -10.15,  +10.17,
-                 -5.570,  +5.565,
-                  0.000, +15.387)
+        template <typename real_t>
+        static void slopes(real_t& mx, real_t& my, real_t& mz, const real_t& x, const real_t& y, const real_t& z, const real_t& a)
+        {
+            mx = -k*x + a*y - y*z;
+            my = x;
+            mz = -z + y*y;
+        }
+
+        template <typename real_t>
+        static void jacobian(real_t J[3][3], const real_t& x, const real_t& y, const real_t& z, const real_t& a)
         {
-            max_dt = 0.001;
+            Fill(J[0][0], -k);
+            J[0][1] = a - z;
+            J[0][2] = -y;
+            Fill(J[1][0], 1);
+            Fill(J[1][1], 0);
+            Fill(J[1][2], 0);
+            Fill(J[2][0], 0);
+            J[2][1] = 2*y;
+            Fill(J[2][2], -1);
         }
     };
 
 
-    class Aizawa : public ChaoticOscillator     // http://www.3d-meier.de/tut19/Seite3.html
+    struct AizawaModel     // http://www.3d-meier.de/tut19/Seite3.html
     {
-    private:
-        const double a = 0.95;
-        const double b = 0.69535;
-        const double d = 3.5;
-        const double e = 0.25;
-        const double f = 0.1;
+        static constexpr double a = 0.95;
+        static constexpr double b = 0.69535;
+        static constexpr double d = 3.5;
+        static constexpr double e = 0.25;
+        static constexpr double f = 0.1;
+
+        static constexpr double x0 =  0.440125;
+        static constexpr double y0 = -0.781267;
+        static constexpr double z0 = -0.277170;
+
+        static constexpr double xmin = -1.505;
+        static constexpr double xmax = +1.490;
+        static constexpr double ymin = -1.455;
+        static constexpr double ymax = +1.530;
+        static constexpr double zmin = -0.370;
+        static constexpr double zmax = +1.853;
+
+        static constexpr double max_dt = 5.0e-05;
+        static constexpr double max_dt_heun = 3.5e-05;
+        static constexpr double max_dt_ralston = 4.0e-05;
+        static constexpr double max_dt_rk4 = 0.0062;
+        static constexpr double max_dt_trapezoid = 6.2e-05;
+
+        static double coefficient(double knob)
+        {
+            return KnobValue(knob, 0.5941, 0.6117);
+        }
 
-    protected:
-        SlopeVector slopes(double x, double y, double z) const override
+        template <typename real_t>
+        static void slopes(real_t& mx, real_t& my, real_t& mz, const real_t& x, const real_t& y, const real_t& z, const real_t& c)
         {
-            const double c = KnobValue(knob, 0.5941, 0.6117);
-            return SlopeVector(
-                (z-b)*x - d*y,
-                d*x + (z-b)*y,
-                c + a*z - z*z*z/3 - (x*x + y*y)*(1 + e*z) + f*z*x*x*x
-            );
+            mx = (z-b)*x - d*y;
+            my = d*x + (z-b)*y;
+            mz = c + a*z - z*z*z/3 - (x*x + y*y)*(1 + e*z) + f*z*x*x*x;
         }
 
-    public:
-        Aizawa()
-            : ChaoticOscillator(
-                0.440125, -0.781267, -0.277170,
-                -1.505, +1.490,
-                -1.455, +1.530,
-                -0.370, +1.853)
+        template <typename real_t>
+        static void jacobian(real_t J[3][3], const real_t& x, const real_t& y, const real_t& z, const real_t&)
         {
-            max_dt = 5.0e-05;
+            J[0][0] = z - b;
+            Fill(J[0][1], -d);
+            J[0][2] = x;
+            Fill(J[1][0], d);
+            J[1][1] = z - b;
+            J[1][2] = y;
+            J[2][0] = -2*x*(1 + e*z) + 3*f*z*x*x;
+            J[2][1] = -2*y*(1 + e*z);
+            J[2][2] = a - z*z - e*(x*x + y*y) + f*x*x*x;
         }
     };
 
 
-    class Sprott : public ChaoticOscillator     // http://www.3d-meier.de/tut19/Seite192.html
+    struct SprottModel     // http://www.3d-meier.de/tut19/Seite192.html
     {
-    private:
-        const double a = 2.5;
-        const double b = 1.5;
+        static constexpr double a = 2.5;
+        static constexpr double b = 1.5;
+
+        static constexpr double x0 = 0.010847;
+        static constexpr double y0 = 0.003817;
+        static constexpr double z0 = 0.485189;
+
+        static constexpr double xmin = -3.91;
+        static constexpr double xmax = +4.07;
+        static constexpr double ymin = -5.66;
+        static constexpr double ymax = +6.01;
+        static constexpr double zmin = -8.44;
+        static constexpr double zmax = +8.09;
+
+        static constexpr double max_dt = 0.0001;
+        static constexpr double max_dt_heun = 7.0e-05;
+        static constexpr double max_dt_ralston = 7.1e-05;
+        static constexpr double max_dt_rk4 = 0.0096;
+        static constexpr double max_dt_trapezoid = 0.000105;
+
+        static double coefficient(double)
+        {
+            return 0.0;
+        }
 
-    protected:
-        SlopeVector slopes(double x, double y, double z) const override
+        template <typename real_t>
+        static void slopes(real_t& mx, real_t& my, real_t& mz, const real_t& x, const real_t& y, const real_t& z, const real_t&)
         {
-            return SlopeVector(
-                a*(y - x),
-                x*z,
-                b - y*y
-            );
+            mx = a*(y - x);
+            my = x*z;
+            mz = b - y*y;
         }
 
-    public:
-        Sprott()
-            : ChaoticOscillator(
-                0.010847, 0.003817, 0.485189,
-                -3.91, +4.07,
-                -5.66, +6.01,
-                -8.44, +8.09)
+        template <typename real_t>
+        static void jacobian(real_t J[3][3], const real_t& x, const real_t& y, const real_t& z, const real_t&)
         {
-            max_dt = 0.0001;
+            Fill(J[0][0], -a);
+            Fill(J[0][1], a);
+            Fill(J[0][2], 0);
+            J[1][0] = z;
+            Fill(J[1][1], 0);
+            J[1][2] = x;
+            Fill(J[2][0], 0);
+            J[2][1] = -2*y;
+            Fill(J[2][2], 0);
         }
     };
 
 
-    class Bouali : public ChaoticOscillator     // http://www.3d-meier.de/tut19/Seite208.html
+    struct BoualiModel     // http://www.3d-meier.de/tut19/Seite208.html
     {
-    private:
-        const double a = 3.0;
-        const double b = 2.2;
-        const double c = 1.0;
-        const double d = 1.491;
+        static constexpr double a = 3.0;
+        static constexpr double b = 2.2;
+        static constexpr double c = 1.0;
+        static constexpr double d = 1.491;
+
+        static constexpr double x0 = 1.03;
+        static constexpr double y0 = 1.05;
+        static constexpr double z0 = 0.012;
+
+        static constexpr double xmin = -4.860;
+        static constexpr double xmax =  4.934;
+        static constexpr double ymin =  0.009;
+        static constexpr double ymax =  6.345;
+        static constexpr double zmin = -3.947;
+        static constexpr double zmax =  3.866;
+
+        static constexpr double max_dt = 0.00018;
+        static constexpr double max_dt_heun = 0.000126;
+        static constexpr double max_dt_ralston = 0.000121;
+        static constexpr double max_dt_rk4 = 0.011;
+        static constexpr double max_dt_trapezoid = 0.000158;
+
+        static double coefficient(double)
+        {
+            return 0.0;
+        }
+
+        template <typename real_t>
+        static void slopes(real_t& mx, real_t& my, real_t& mz, const real_t& x, const real_t& y, const real_t& z, const real_t&)
+        {
+            mx = a*x*(1 - y) - b*z;
+            my = -c*y*(1 - x*x);
+            mz = d*x;
+        }
 
+        template <typename real_t>
+        static void jacobian(real_t J[3][3], const real_t& x, const real_t& y, const real_t& z, const real_t&)
+        {
+            J[0][0] = a*(1 - y);
+            J[0][1] = -a*x;
+            Fill(J[0][2], -b);
+            J[1][0] = 2*c*x*y;
+            J[1][1] = -c*(1 - x*x);
+            Fill(J[1][2], 0);
+            Fill(J[2][0], d);
+            Fill(J[2][1], 0);
+            Fill(J[2][2], 0);
+        }
+    };
+
+
+    template <typename model_t, typename integrator_t = MidpointIntegrator>
+    class ModelOscillator : public ChaoticOscillator
+    {
     protected:
         SlopeVector slopes(double x, double y, double z) const override
         {
-            return SlopeVector(
-                a*x*(1 - y) - b*z,
-                -c*y*(1 - x*x),
-                d*x
-            );
+            double mx, my, mz;
+            model_t::slopes(mx, my, mz, x, y, z, coeff);
+            return SlopeVector(mx, my, mz);
+        }
+
+        double coefficient(double k) const override
+        {
+            return model_t::coefficient(k);
+        }
+
+        void integrate(double& x, double& y, double& z, double dt) const override
+        {
+            countSlopeCalls(integrator_t::evaluations);
+            integrator_t::step(x, y, z, dt, ModelSlopes<model_t>{coeff});
         }
 
     public:
-        Bouali()
+        ModelOscillator()
             : ChaoticOscillator(
-                1.03, 1.05, 0.012,
-                -4.860, 4.934,
-                 0.009, 6.345,
-                -3.947, 3.866)
-            {
-                max_dt = 0.00018;
-            }
+                model_t::x0, model_t::y0, model_t::z0,
+                model_t::xmin, model_t::xmax,
+                model_t::ymin, model_t::ymax,
+                model_t::zmin, model_t::zmax)
+        {
+            max_dt = integrator_t::template maxStep<model_t>();
+            coeff = model_t::coefficient(knob);
+        }
     };
+
+
+    class Rucklidge : public ModelOscillator<RucklidgeModel> {};
+    class Aizawa    : public ModelOscillator<AizawaModel>    {};
+    class Sprott    : public ModelOscillator<SprottModel>    {};
+    class Bouali    : public ModelOscillator<BoualiModel>    {};
 }
@@ -0,0 +1,441 @@
+/*
+    Integrators.hpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Numerical integration schemes for the 3-dimensional chaotic oscillators.
+    Each scheme is written as a template over the real number type
+    (double or a SIMD lane vector) and over a slope function with the signature
+
+        void slopes(real_t& mx, real_t& my, real_t& mz, const real_t& x, const real_t& y, const real_t& z);
+
+    Implicit schemes also need the Jacobian matrix of the slopes,
+    provided by a `jacobian(J, x, y, z)` member of the slope function object;
+    ModelSlopes adapts any model from ChaoticOscillator.hpp to both interfaces.
+
+    The fixed-step integrator policies (MidpointIntegrator, HeunIntegrator, ...)
+    can be plugged into ModelOscillator, BasicOscillator and OscillatorBank.
+    Each policy selects its own maximum time increment from the model,
+    because the error of a step depends on the scheme as much as on the system.
+
+    Measured with g++ -O3 (BasicOscillator, 44.1 kHz, animate speed 1 and 1000).
+    "bound" is the largest step keeping the trajectory finite and within
+    AMPLITUDE + 0.1 for 600 simulated seconds (the rangetest criterion);
+    each max_dt is far below it because it is an accuracy limit.
+
+        kind   policy    max_dt    bound   evals/sample (x1, x1000)   ns/sample (x1, x1000)
+        aiza   midpoint  5.0e-05   0.24      3  1362                   47  24082
+        aiza   heun      3.5e-05   0.044     2  1296                   33  22518
+        aiza   ralston   4.0e-05   0.046     2  1134                   34  20613
+        aiza   rk4       0.0062    0.49      4    16                   65    273
+        aiza   trapezoid 6.2e-05   0.099     3  1098                   85  35586
+        boul   midpoint  0.00018   0.36      3   378                   26   3791
+        boul   heun      0.000126  0.18      2   360                   18   3314
+        boul   ralston   0.000121  0.046     2   376                   20   3919
+        boul   rk4       0.011     0.47      4    12                   37    118
+        boul   trapezoid 0.000158  0.68      3   432                   51   7762
+        ruck   midpoint  0.001     0.66      3    69                   23    542
+        ruck   heun      0.0007    0.40      2    66                   20    521
+        ruck   ralston   0.00069   0.36      2    66                   20    594
+        ruck   rk4       0.034     0.86      4     4                   42     34
+        ruck   trapezoid 0.00094   1.2       3    75                   46   1107
+        sprot  midpoint  0.0001    0.53      3   681                   30   4863
+        sprot  heun      7.0e-05   0.18      2   648                   19   4556
+        sprot  ralston   7.1e-05   0.19      2   640                   22   4957
+        sprot  rk4       0.0096    0.50      4    12                   41     91
+        sprot  trapezoid 0.000105  0.86      3   648                   52  11429
+
+    The implicit TrapezoidIntegrator needs the model's analytic Jacobian.
+    None of these systems is stiff: the explicit schemes stay bounded at steps
+    thousands of times larger than max_dt, so oversampling is driven by accuracy,
+    and at equal accuracy the implicit scheme costs more per sample.
+    It is useful for models that are stiff, and for deliberately coarse steps.
+
+    Symplectic schemes are not offered: these systems are dissipative,
+    so there is no conserved quantity for such a scheme to preserve.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+namespace Analog
+{
+    template <typename model_t, typename real_t = double>
+    struct ModelSlopes
+    {
+        real_t c;       // model coefficient derived from the knob
+
+        void operator() (real_t& mx, real_t& my, real_t& mz, const real_t& x, const real_t& y, const real_t& z) const
+        {
+            model_t::slopes(mx, my, mz, x, y, z, c);
+        }
+
+        void jacobian(real_t J[3][3], const real_t& x, const real_t& y, const real_t& z) const
+        {
+            model_t::jacobian(J, x, y, z, c);
+        }
+    };
+
+
+    template <typename real_t, typename slope_func_t>
+    inline void MidpointStep(real_t& x, real_t& y, real_t& z, double dt, const slope_func_t& slopes)
+    {
+        // Estimate the slopes at the middle of the time interval,
+        // refining the estimate a fixed number of times.
+        const int max_iter = 2;
+        real_t mx, my, mz;
+        slopes(mx, my, mz, x, y, z);
+        real_t dx = dt * mx;
+        real_t dy = dt * my;
+        real_t dz = dt * mz;
+        for (int iter = 0; iter < max_iter; ++iter)
+        {
+            real_t xm = x + dx/2;
+            real_t ym = y + dy/2;
+            real_t zm = z + dz/2;
+            slopes(mx, my, mz, xm, ym, zm);
+            dx = dt * mx;
+            dy = dt * my;
+            dz = dt * mz;
+        }
+        x += dx;
+        y += dy;
+        z += dz;
+    }
+
+
+    struct AdaptiveState
+    {
+        double tolerance = 0.0;     // maximum local error per step; 0 disables adaptive stepping
+        double h = 0.0;             // step size proposed for the next step; 0 = not yet known
+
+        // First-same-as-last: the slope at the end of an accepted step
+        // is the slope at the start of the next one.
+        bool haveSlope = false;
+        double mx{};
+        double my{};
+        double mz{};
+
+        void reset()
+        {
+            h = 0.0;
+            haveSlope = false;
+        }
+    };
+
+
+    template <typename slope_func_t>
+    inline int AdaptiveAdvance(AdaptiveState& a, double& x, double& y, double& z, double dt, double h_init, const slope_func_t& slopes)
+    {
+        // Advance exactly `dt` seconds using the Bogacki-Shampine 3(2) embedded Runge-Kutta pair,
+        // choosing each step size so the estimated local error stays within `a.tolerance`.
+        // Every attempted step, accepted or rejected, costs 3 slope evaluations.
+        // Returns the number of steps attempted, accepted or rejected.
+        // A diverging state cannot stall the caller: a non-finite error estimate
+        // shrinks the step like any rejection, steps at h_min are always accepted,
+        // and after max_attempts the rest of `dt` is taken in one step, accurate or not.
+        const double safety = 0.9;
+        const double min_scale = 0.2;
+        const double max_scale = 5.0;
+        const double h_min = dt * 1.0e-9;
+        const int max_attempts = 10000;
+
+        if (!a.haveSlope)
+        {
+            slopes(a.mx, a.my, a.mz, x, y, z);
+            a.haveSlope = true;
+        }
+        if (a.h <= 0.0)
+            a.h = (h_init > 0.0) ? h_init : dt;
+
+        int attempts = 0;
+        double remaining = dt;
+        while (remaining > 0.0)
+        {
+            const bool forced = (++attempts >= max_attempts);
+            const bool last = forced || (a.h >= remaining);
+            const double h = last ? remaining : a.h;
+
+            double k2x, k2y, k2z;
+            slopes(k2x, k2y, k2z, x + h/2*a.mx, y + h/2*a.my, z + h/2*a.mz);
+
+            double k3x, k3y, k3z;
+            slopes(k3x, k3y, k3z, x + 3*h/4*k2x, y + 3*h/4*k2y, z + 3*h/4*k2z);
+
+            const double xn = x + h*(2*a.mx + 3*k2x + 4*k3x)/9;
+            const double yn = y + h*(2*a.my + 3*k2y + 4*k3y)/9;
+            const double zn = z + h*(2*a.mz + 3*k2z + 4*k3z)/9;
+
+            double k4x, k4y, k4z;
+            slopes(k4x, k4y, k4z, xn, yn, zn);
+
+            // Difference between the 3rd order and the embedded 2nd order solutions.
+            const double ex = h*(-5*a.mx + 6*k2x + 8*k3x - 9*k4x)/72;
+            const double ey = h*(-5*a.my + 6*k2y + 8*k3y - 9*k4y)/72;
+            const double ez = h*(-5*a.mz + 6*k2z + 8*k3z - 9*k4z)/72;
+
+            // Mixed absolute/relative error, normalized so that 1 means "exactly at tolerance".
+            const double err = std::max({
+                std::abs(ex) / (1 + std::max(std::abs(x), std::abs(xn))),
+                std::abs(ey) / (1 + std::max(std::abs(y), std::abs(yn))),
+                std::abs(ez) / (1 + std::max(std::abs(z), std::abs(zn)))
+            }) / a.tolerance;
+
+            const double scale =
+                !std::isfinite(err) ? min_scale :
+                (err > 0.0) ? safety * std::cbrt(1.0 / err) :
+                max_scale;
+
+            if (err <= 1.0 || h <= h_min || forced)
+            {
+                x = xn;
+                y = yn;
+                z = zn;
+                a.mx = k4x;
+                a.my = k4y;
+                a.mz = k4z;
+                remaining = last ? 0.0 : (remaining - h);
+                // A step shortened to land on the sample boundary says nothing about the step size.
+                if (!last || scale < 1.0)
+                    a.h = std::max(h_min, h * std::min(max_scale, scale));
+            }
+            else
+            {
+                // Shrink the step and try again.
+                a.h = std::max(h_min, h * std::max(min_scale, scale));
+            }
+        }
+        return attempts;
+    }
+
+
+    struct DenseOutput
+    {
+        // One internal integration step, remembered so that outputs at any time
+        // within it can be interpolated. The state at the end of the step is the
+        // oscillator's own state, which therefore runs up to one step ahead of the output.
+        bool started = false;
+        double h = 0.0;         // length of the step in seconds
+        double t = 0.0;         // time of the latest output, measured from the start of the step
+        double p0[3]{};         // state at the start of the step
+        double m0[3]{};         // slope at the start of the step
+        double m1[3]{};         // slope at the end of the step
+
+        void reset()
+        {
+            started = false;
+        }
+    };
+
+
+    inline double HermiteInterpolate(double p0, double m0, double p1, double m1, double h, double s)
+    {
+        // Cubic Hermite interpolation between p0 (at s=0) and p1 (at s=1)
+        // with slopes m0 and m1 per unit time over a step of length h.
+        const double s2 = s*s;
+        const double s3 = s2*s;
+        return (2*s3 - 3*s2 + 1)*p0 + (s3 - 2*s2 + s)*h*m0 + (3*s2 - 2*s3)*p1 + (s3 - s2)*h*m1;
+    }
+
+
+    template <typename step_func_t, typename slope_func_t>
+    inline void DenseAdvance(
+        DenseOutput& d,
+        double& x, double& y, double& z,
+        double interval, double h,
+        step_func_t step, const slope_func_t& slopes,
+        double& ox, double& oy, double& oz)
+    {
+        // Move the output time forward by `interval` seconds, taking internal steps
+        // of `h` seconds only when the output time passes the end of the current step.
+        // The interpolated state at the new output time is written to (ox, oy, oz).
+        // A non-positive interval repeats the previous output time. Until a step
+        // of positive length has been taken, the output is the current state.
+        if (!d.started)
+        {
+            slopes(d.m1[0], d.m1[1], d.m1[2], x, y, z);
+            d.started = true;
+            d.h = 0.0;
+            d.t = 0.0;
+        }
+
+        d.t += std::max(0.0, interval);
+        while (d.t > d.h && h > 0.0)
+        {
+            d.t -= d.h;
+            d.p0[0] = x;
+            d.p0[1] = y;
+            d.p0[2] = z;
+            d.m0[0] = d.m1[0];
+            d.m0[1] = d.m1[1];
+            d.m0[2] = d.m1[2];
+            step(x, y, z, h);
+            slopes(d.m1[0], d.m1[1], d.m1[2], x, y, z);
+            d.h = h;
+        }
+
+        if (d.h <= 0.0)
+        {
+            ox = x;
+            oy = y;
+            oz = z;
+            return;
+        }
+
+        const double s = d.t / d.h;
+        ox = HermiteInterpolate(d.p0[0], d.m0[0], x, d.m1[0], d.h, s);
+        oy = HermiteInterpolate(d.p0[1], d.m0[1], y, d.m1[1], d.h, s);
+        oz = HermiteInterpolate(d.p0[2], d.m0[2], z, d.m1[2], d.h, s);
+    }
+
+
+    struct MidpointIntegrator
+    {
+        // Second order, 3 slope evaluations per step: the original scheme.
+        static constexpr int evaluations = 3;
+
+        template <typename model_t>
+        static constexpr double maxStep() { return model_t::max_dt; }
+
+        template <typename real_t, typename slope_func_t>
+        static void step(real_t& x, real_t& y, real_t& z, double dt, const slope_func_t& slopes)
+        {
+            MidpointStep(x, y, z, dt, slopes);
+        }
+    };
+
+
+    struct HeunIntegrator
+    {
+        // Second order, 2 slope evaluations per step:
+        // average the slopes at both ends of an Euler predictor step.
+        static constexpr int evaluations = 2;
+
+        template <typename model_t>
+        static constexpr double maxStep() { return model_t::max_dt_heun; }
+
+        template <typename real_t, typename slope_func_t>
+        static void step(real_t& x, real_t& y, real_t& z, double dt, const slope_func_t& slopes)
+        {
+            real_t ax, ay, az;
+            slopes(ax, ay, az, x, y, z);
+            real_t bx, by, bz;
+            slopes(bx, by, bz, x + dt*ax, y + dt*ay, z + dt*az);
+            x += dt*(ax + bx)/2;
+            y += dt*(ay + by)/2;
+            z += dt*(az + bz)/2;
+        }
+    };
+
+
+    struct RalstonIntegrator
+    {
+        // Second order, 2 slope evaluations per step,
+        // with the smallest truncation error bound of the 2-stage methods.
+        static constexpr int evaluations = 2;
+
+        template <typename model_t>
+        static constexpr double maxStep() { return model_t::max_dt_ralston; }
+
+        template <typename real_t, typename slope_func_t>
+        static void step(real_t& x, real_t& y, real_t& z, double dt, const slope_func_t& slopes)
+        {
+            real_t ax, ay, az;
+            slopes(ax, ay, az, x, y, z);
+            real_t bx, by, bz;
+            slopes(bx, by, bz, x + (2*dt/3)*ax, y + (2*dt/3)*ay, z + (2*dt/3)*az);
+            x += dt*(ax + 3*bx)/4;
+            y += dt*(ay + 3*by)/4;
+            z += dt*(az + 3*bz)/4;
+        }
+    };
+
+
+    struct Rk4Integrator
+    {
+        // Classic fourth order Runge-Kutta, 4 slope evaluations per step.
+        static constexpr int evaluations = 4;
+
+        template <typename model_t>
+        static constexpr double maxStep() { return model_t::max_dt_rk4; }
+
+        template <typename real_t, typename slope_func_t>
+        static void step(real_t& x, real_t& y, real_t& z, double dt, const slope_func_t& slopes)
+        {
+            real_t ax, ay, az;
+            slopes(ax, ay, az, x, y, z);
+            real_t bx, by, bz;
+            slopes(bx, by, bz, x + (dt/2)*ax, y + (dt/2)*ay, z + (dt/2)*az);
+            real_t cx, cy, cz;
+            slopes(cx, cy, cz, x + (dt/2)*bx, y + (dt/2)*by, z + (dt/2)*bz);
+            real_t dx, dy, dz;
+            slopes(dx, dy, dz, x + dt*cx, y + dt*cy, z + dt*cz);
+            x += dt*(ax + 2*bx + 2*cx + dx)/6;
+            y += dt*(ay + 2*by + 2*cy + dy)/6;
+            z += dt*(az + 2*bz + 2*cz + dz)/6;
+        }
+    };
+
+
+    struct TrapezoidIntegrator
+    {
+        // Implicit trapezoidal rule: second order and A-stable.
+        // Solves u = p + dt/2*(f(p) + f(u)) for the new state u with a fixed number
+        // of Newton iterations using the analytic Jacobian, starting from an Euler predictor.
+        // The fixed iteration count keeps the step branch-free, so it also works on SIMD lanes.
+        static constexpr int newton_iterations = 2;
+        static constexpr int evaluations = 1 + newton_iterations;
+
+        template <typename model_t>
+        static constexpr double maxStep() { return model_t::max_dt_trapezoid; }
+
+        template <typename real_t, typename slope_func_t>
+        static void step(real_t& x, real_t& y, real_t& z, double dt, const slope_func_t& slopes)
+        {
+            real_t ax, ay, az;
+            slopes(ax, ay, az, x, y, z);
+
+            // Everything that does not depend on the new state.
+            const real_t px = x + (dt/2)*ax;
+            const real_t py = y + (dt/2)*ay;
+            const real_t pz = z + (dt/2)*az;
+
+            real_t ux = x + dt*ax;
+            real_t uy = y + dt*ay;
+            real_t uz = z + dt*az;
+            for (int iter = 0; iter < newton_iterations; ++iter)
+            {
+                real_t bx, by, bz;
+                slopes(bx, by, bz, ux, uy, uz);
+
+                // Residual G(u) = u - p - dt/2*f(u), and its Jacobian M = I - dt/2*J(u).
+                const real_t gx = ux - px - (dt/2)*bx;
+                const real_t gy = uy - py - (dt/2)*by;
+                const real_t gz = uz - pz - (dt/2)*bz;
+
+                real_t J[3][3];
+                slopes.jacobian(J, ux, uy, uz);
+                const real_t m00 = 1 - (dt/2)*J[0][0], m01 =   - (dt/2)*J[0][1], m02 =   - (dt/2)*J[0][2];
+                const real_t m10 =   - (dt/2)*J[1][0], m11 = 1 - (dt/2)*J[1][1], m12 =   - (dt/2)*J[1][2];
+                const real_t m20 =   - (dt/2)*J[2][0], m21 =   - (dt/2)*J[2][1], m22 = 1 - (dt/2)*J[2][2];
+
+                // Solve M*delta = G by Cramer's rule.
+                const real_t c00 = m11*m22 - m12*m21;
+                const real_t c01 = m12*m20 - m10*m22;
+                const real_t c02 = m10*m21 - m11*m20;
+                const real_t det = m00*c00 + m01*c01 + m02*c02;
+                const real_t inv = 1 / det;
+                const real_t delta_x = (gx*c00 + m01*(m12*gz - gy*m22) + m02*(gy*m21 - m11*gz)) * inv;
+                const real_t delta_y = (m00*(gy*m22 - m12*gz) + gx*c01 + m02*(m10*gz - gy*m20)) * inv;
+                const real_t delta_z = (m00*(m11*gz - gy*m21) + m01*(gy*m20 - m10*gz) + gx*c02) * inv;
+
+                ux -= delta_x;
+                uy -= delta_y;
+                uz -= delta_z;
+            }
+            x = ux;
+            y = uy;
+            z = uz;
+        }
+    };
+}
@@ -7,12 +7,185 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include "ChaoticOscillator.hpp"
 
 namespace Analog
 {
-    class JerkCircuit
+    inline double FastExp(double u)
+    {
+        // exp(u) with a short dependency chain and no branches or table lookups,
+        // so the compiler can vectorize loops that call it.
+        // Range reduction: u = k*ln(2) + r, with integer k and |r| <= ln(2)/2,
+        // so exp(u) = 2^k * exp(r). exp(r) is its Taylor series through r^13,
+        // evaluated in a tree of independent products instead of Horner's chain.
+        // 2^k is assembled in the exponent bits of the number that rounded u/ln(2).
+        // Maximum relative error versus expl: 4.2e-16 (about 2 ulp) over the whole range.
+        // Inputs below -708 return exp(-708) = 3.3e-308; inputs above 709 return exp(709).
+        const double k = 1.4426950408889634;                // 1/ln(2)
+        const double hi = 6.93147180369123816490e-01;       // ln(2) split so that n*hi is exact
+        const double lo = 1.90821492927058770002e-10;
+        const double shifter = 6755399441055744.0;          // 1.5 * 2^52: adding it rounds to an integer
+
+        u = std::max(-708.0, std::min(709.0, u));
+        const double t = u*k + shifter;
+        const double n = t - shifter;
+        const double r = (u - n*hi) - n*lo;
+
+        const double r2 = r*r;
+        const double r4 = r2*r2;
+        const double r8 = r4*r4;
+        const double p =
+            ((1.0 + r) + r2*(1.0/2 + r*(1.0/6))) +
+            r4*((1.0/24 + r*(1.0/120)) + r2*(1.0/720 + r*(1.0/5040))) +
+            r8*(((1.0/40320 + r*(1.0/362880)) + r2*(1.0/3628800 + r*(1.0/39916800))) +
+                r4*(1.0/479001600 + r*(1.0/6227020800)));
+
+        // The low mantissa bits of t hold k as an integer. Adding the exponent bias
+        // and shifting it into place builds 2^k; the shift discards the rest of t.
+        std::uint64_t bits;
+        std::memcpy(&bits, &t, sizeof(bits));
+        bits = (bits + 1023) << 52;
+        double scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+        return scale * p;
+    }
+
+
+    // Diode current as a function of voltage, fitted to measurements of a red LED:
+    // don@doctorno:~/github/diodeplot$ ./run red_3
+    // A=-26.714774051906932, B=112.53225596759907, C=-115.91134470261159
+    // The models are template parameters of BasicJerkCircuit so the choice
+    // between exact and fast arithmetic is made at compile time.
+
+    struct ExactDiode
+    {
+        static constexpr double A =  -26.714774051906932;
+        static constexpr double B = +112.53225596759907;
+        static constexpr double C = -115.91134470261159;
+        static constexpr double expC = 4.5744891902281526e-51;     // std::exp(C)
+
+        static double current(double voltage)
+        {
+            return std::exp(A*voltage*voltage + B*voltage + C) - expC;
+        }
+
+        // Current and its derivative dI/dV, sharing one exponential.
+        static double current(double voltage, double& conductance)
+        {
+            const double e = std::exp(A*voltage*voltage + B*voltage + C);
+            conductance = (2*A*voltage + B) * e;
+            return e - expC;
+        }
+    };
+
+
+    struct FastDiode
+    {
+        // Same fit as ExactDiode, with bounded error:
+        // - When the exponent is below `cutoff` (voltages below 0.575 V), the diode
+        //   is treated as off: the returned current is -exp(C), in error by less than
+        //   exp(-60) = 8.8e-27 A. That is about 1e-7 of the rounding error of the
+        //   milliampere currents summed with it at the same node.
+        // - Otherwise the exponent is between -60 and +2.6 and FastExp's
+        //   relative error stays below 5e-16.
+        // The voltages the circuit reaches (about -3.7 V to +1.8 V) keep the diode off
+        // about half of the time, and those calls skip the exponential altogether.
+        // This is the one branch: BasicJerkCircuit solves one sample at a time, so it
+        // predicts well and is cheaper than always evaluating FastExp. Code evaluating
+        // many voltages at once can call FastExp unconditionally; it is accurate down to -708.
+        static constexpr double cutoff = -60.0;
+
+        static double current(double voltage)
+        {
+            using D = ExactDiode;
+            const double u = D::A*voltage*voltage + D::B*voltage + D::C;
+            return ((u < cutoff) ? 0.0 : FastExp(u)) - D::expC;
+        }
+
+        static double current(double voltage, double& conductance)
+        {
+            using D = ExactDiode;
+            const double u = D::A*voltage*voltage + D::B*voltage + D::C;
+            const double e = (u < cutoff) ? 0.0 : FastExp(u);
+            conductance = (2*D::A*voltage + D::B) * e;
+            return e - D::expC;
+        }
+    };
+
+
+    // How BasicJerkCircuit::update solves for each sample's voltage increments.
+    // Fixed-point iteration stops contracting once the diode conducts, and then
+    // runs into iterationLimit; Newton's method converges in 2-3 iterations
+    // and stays stable at larger time steps.
+    enum class JerkSolver
+    {
+        FixedPoint,     // re-evaluate the increments from the previous estimate (default)
+        Newton,         // Newton's method using the diode's conductance
+    };
+
+
+    // Convergence telemetry accumulated by BasicJerkCircuit::update.
+    struct JerkSolverStats
+    {
+        static constexpr int histogramSize = 16;
+
+        long samples = 0;
+        long iterations[histogramSize] = {};    // samples that used n iterations; the last bin also counts more
+        long limitHits = 0;                     // samples stopped by iterationLimit before converging
+        double maxResidual = 0;                 // largest final correction, in volts
+
+        void reset()
+        {
+            *this = JerkSolverStats{};
+        }
+
+        void record(int iter, bool converged, double residual)
+        {
+            ++samples;
+            ++iterations[std::min(iter, histogramSize-1)];
+            if (!converged)
+                ++limitHits;
+            maxResidual = std::max(maxResidual, residual);
+        }
+
+        // Each iteration evaluates the diode once.
+        long diodeEvaluations() const
+        {
+            long sum = 0;
+            for (int n = 1; n < histogramSize; ++n)
+                sum += n * iterations[n];
+            return sum;
+        }
+
+        double meanIterations() const
+        {
+            return (samples > 0) ? static_cast<double>(diodeEvaluations()) / samples : 0.0;
+        }
+    };
+
+
+    // Component values of the Jerk Circuit, nominally as built by Sprott.
+    struct JerkComponents
+    {
+        double R1 = 1000;
+        double R2 = 1000;
+        double R3 = 1000;
+        double R4 = 1000;
+        double R5 = 1000;
+        double R6 = 1000;
+
+        double C1 = 1.0e-6;
+        double C2 = 1.0e-6;
+        double C3 = 1.0e-6;
+    };
+
+
+    template <typename diode_t>
+    class BasicJerkCircuit
     {
     private:
         const double timeDilation;
@@ -20,27 +193,16 @@ namespace Analog
         const double x0;    // initial voltage of capacitor C2
         const double y0;    // initial voltage of capacitor C3
 
-        const double R1 = 1000;
-        const double R2 = 1000;
-        const double R3 = 1000;
-        const double R4 = 1000;
-        const double R5 = 1000;
-        const double R6 = 1000;
+        const double R1;
+        const double R2;
+        const double R3;
+        const double R4;
+        const double R5;
+        const double R6;
 
-        const double C1 = 1.0e-6;
-        const double C2 = 1.0e-6;
-        const double C3 = 1.0e-6;
-
-        static double diodeCurrent(double voltage)
-        {
-            // don@doctorno:~/github/diodeplot$ ./run red_3
-            // A=-26.714774051906932, B=112.53225596759907, C=-115.91134470261159
-            const double A =  -26.714774051906932;
-            const double B = +112.53225596759907;
-            const double C = -115.91134470261159;
-            double current = std::exp(A*voltage*voltage + B*voltage + C) - std::exp(C);
-            return current;
-        }
+        const double C1;
+        const double C2;
+        const double C3;
 
         // Node voltages
         double w1{};     // voltage at node  1
@@ -53,14 +215,80 @@ namespace Analog
         double dx{};
         double dy{};
 
+        JerkSolver solver = JerkSolver::FixedPoint;
+        JerkSolverStats telemetry;
+
+        int updateNewton(double dt)
+        {
+            // Solve the implicit midpoint equations for the increments dw, dx, dy:
+            //     F(d) = d + dt*(currents at the midpoint voltages)/C = 0
+            // Each Newton step solves J*delta = -F, where J is sparse enough
+            // to eliminate by hand. The previous sample's increments are the initial guess.
+            const double k = R6/R4;
+            const double a = dt/C1;
+            const double b = dt/C2;
+            const double c = dt/C3;
+            const double s = a/(2*R5);
+            const double t = b/(2*R2);
+            const double u = c/(2*R3);
+            const double tolerance = 1.0e-12;        // one picovolt
+            const double toleranceSquared = tolerance * tolerance;
+
+            for (int iter = 1; true; ++iter)
+            {
+                const double wm = w1 + dw/2;
+                const double xm = x1 + dx/2;
+                const double ym = y1 + dy/2;
+                const double zm = -k*xm;
+
+                double g;
+                const double current = diode_t::current(zm, g);
+                const double fw = dw + a*(wm/R1 + current + ym/R5);
+                const double fx = dx + b*(wm/R2);
+                const double fy = dy + c*(xm/R3);
+
+                // J = [p q s; t 1 0; 0 u 1]
+                const double p = 1 + a/(2*R1);
+                const double q = -a*g*k/2;
+                const double ew = (-fw + q*fx + s*fy - s*u*fx) / (p - q*t + s*u*t);
+                const double ex = -fx - t*ew;
+                const double ey = -fy - u*ex;
+
+                dw += ew;
+                dx += ex;
+                dy += ey;
+
+                const double variance = ew*ew + ex*ex + ey*ey;
+                const bool converged = variance < toleranceSquared;
+                if (converged || iter >= iterationLimit)
+                {
+                    w1 += dw;
+                    x1 += dx;
+                    y1 += dy;
+                    z1 = -k*x1;
+                    telemetry.record(iter, converged, std::sqrt(variance));
+                    return iter;
+                }
+            }
+        }
+
     public:
         const int iterationLimit = 5;
 
-        JerkCircuit(double _timeDilation, double _w0, double _x0, double _y0)
+        BasicJerkCircuit(double _timeDilation, double _w0, double _x0, double _y0, const JerkComponents& parts = JerkComponents{})
             : timeDilation(_timeDilation)
             , w0(_w0)
             , x0(_x0)
             , y0(_y0)
+            , R1(parts.R1)
+            , R2(parts.R2)
+            , R3(parts.R3)
+            , R4(parts.R4)
+            , R5(parts.R5)
+            , R6(parts.R6)
+            , C1(parts.C1)
+            , C2(parts.C2)
+            , C3(parts.C3)
         {
             initialize();
         }
@@ -74,9 +302,18 @@ namespace Analog
             dw = dx = dy = 0;
         }
 
+        void setSolver(JerkSolver _solver) { solver = _solver; }
+        JerkSolver getSolver() const { return solver; }
+
+        const JerkSolverStats& stats() const { return telemetry; }
+        void resetStats() { telemetry.reset(); }
+
+        // Advance one sample. Returns the number of solver iterations used.
         int update(float sampleRateHz)
         {
             double dt = timeDilation / sampleRateHz;
+            if (solver == JerkSolver::Newton)
+                return updateNewton(dt);
 
             // Form an initial guess about the mean voltage during the time interval `dt`.
             // Use linear extrapolation to guess that the voltages will keep changing
@@ -98,7 +335,7 @@ namespace Analog
                 double ey = dy;
 
                 // Update the finite changes of the voltage variables after the time interval.
-                dw = -dt/C1*(wm/R1 + diodeCurrent(zm) + ym/R5);
+                dw = -dt/C1*(wm/R1 + diode_t::current(zm) + ym/R5);
                 dx = -dt/C2*(wm/R2);
                 dy = -dt/C3*(xm/R3);
 
@@ -115,7 +352,8 @@ namespace Analog
                 double ddx = dx - ex;
                 double ddy = dy - ey;
                 double variance = ddx*ddx + ddw*ddw + ddy*ddy;
-                if (variance < toleranceSquared || iter >= iterationLimit)
+                bool converged = variance < toleranceSquared;
+                if (converged || iter >= iterationLimit)
                 {
                     // The solution has converged, or we have hit the iteration safety limit.
                     // Update the circuit state voltages and return.
@@ -123,6 +361,7 @@ namespace Analog
                     w1 = w2;
                     y1 = y2;
                     z1 = z2;
+                    telemetry.record(iter, converged, std::sqrt(variance));
                     return iter;
                 }
 
@@ -139,4 +378,8 @@ namespace Analog
         double yVoltage() const { return y1; }
         double zVoltage() const { return z1; }
     };
+
+
+    using JerkCircuit = BasicJerkCircuit<ExactDiode>;
+    using FastJerkCircuit = BasicJerkCircuit<FastDiode>;
 }
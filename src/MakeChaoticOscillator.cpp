@@ -30,4 +30,34 @@ namespace Analog
 
         return nullptr;
     }
+
+    bool LoadRangeTable(ChaoticOscillator& osc, const char *kind)
+    {
+        char filename[100];
+        std::optional<RangeTable> table = LoadRangeTable(RangeTableFileName(kind, filename, sizeof(filename)), kind);
+        if (!table)
+            return false;
+        osc.setRangeTable(*table);
+        return true;
+    }
+
+    std::optional<AnyOscillator> MakeAnyOscillator(const char *kind)
+    {
+        if (kind == nullptr)
+            return std::nullopt;
+
+        if (!strcmp(kind, "aiza"))
+            return BasicOscillator<AizawaModel>();
+
+        if (!strcmp(kind, "boul"))
+            return BasicOscillator<BoualiModel>();
+
+        if (!strcmp(kind, "ruck"))
+            return BasicOscillator<RucklidgeModel>();
+
+        if (!strcmp(kind, "sprot"))
+            return BasicOscillator<SprottModel>();
+
+        return std::nullopt;
+    }
 }
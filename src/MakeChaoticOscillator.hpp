@@ -1,10 +1,28 @@
 #pragma once
 #include <memory>
+#include <optional>
+#include <variant>
 #include <vector>
 #include "ChaoticOscillator.hpp"
+#include "BasicOscillator.hpp"
 
 namespace Analog
 {
     extern const std::vector<const char *> ChaoticOscillatorKinds;
     std::unique_ptr<ChaoticOscillator> MakeChaoticOscillator(const char *kind);
+
+    // Load the range table "<kind>.range" from the current directory into `osc`, if it exists.
+    // Returns true if a table was loaded.
+    bool LoadRangeTable(ChaoticOscillator& osc, const char *kind);
+
+    // Statically dispatched oscillators: call through std::visit
+    // so that the whole sample loop is compiled for one model at a time.
+    using AnyOscillator = std::variant<
+        BasicOscillator<AizawaModel>,
+        BasicOscillator<BoualiModel>,
+        BasicOscillator<RucklidgeModel>,
+        BasicOscillator<SprottModel>
+    >;
+
+    std::optional<AnyOscillator> MakeAnyOscillator(const char *kind);
 }
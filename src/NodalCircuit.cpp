@@ -0,0 +1,652 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+#include <strings.h>
+#include <utility>
+#include "NodalCircuit.hpp"
+
+namespace Analog
+{
+    // Dense LU factorization with partial pivoting, in place.
+    // Returns false if the matrix is singular.
+    static bool LuFactor(std::vector<double>& a, std::vector<int>& perm, int n)
+    {
+        perm.resize(n);
+        for (int i = 0; i < n; ++i)
+            perm[i] = i;
+
+        for (int k = 0; k < n; ++k)
+        {
+            int p = k;
+            for (int i = k+1; i < n; ++i)
+                if (std::abs(a[i*n + k]) > std::abs(a[p*n + k]))
+                    p = i;
+
+            if (a[p*n + k] == 0.0)
+                return false;
+
+            if (p != k)
+            {
+                for (int j = 0; j < n; ++j)
+                    std::swap(a[k*n + j], a[p*n + j]);
+                std::swap(perm[k], perm[p]);
+            }
+
+            for (int i = k+1; i < n; ++i)
+            {
+                const double f = a[i*n + k] / a[k*n + k];
+                a[i*n + k] = f;
+                for (int j = k+1; j < n; ++j)
+                    a[i*n + j] -= f * a[k*n + j];
+            }
+        }
+        return true;
+    }
+
+
+    // Solve A*x = b using the output of LuFactor. `b` is replaced by `x`.
+    static void LuSolve(const std::vector<double>& lu, const std::vector<int>& perm, int n, double *b)
+    {
+        std::vector<double> y(n);
+        for (int i = 0; i < n; ++i)
+        {
+            double sum = b[perm[i]];
+            for (int j = 0; j < i; ++j)
+                sum -= lu[i*n + j] * y[j];
+            y[i] = sum;
+        }
+        for (int i = n-1; i >= 0; --i)
+        {
+            double sum = y[i];
+            for (int j = i+1; j < n; ++j)
+                sum -= lu[i*n + j] * b[j];
+            b[i] = sum / lu[i*n + i];
+        }
+    }
+
+
+    void NodalCircuit::stampLinear(std::vector<double>& a, int n, double dt) const
+    {
+        auto stamp = [&a, n](int p, int q, double g)
+        {
+            if (p >= 0) a[p*n + p] += g;
+            if (q >= 0) a[q*n + q] += g;
+            if (p >= 0 && q >= 0)
+            {
+                a[p*n + q] -= g;
+                a[q*n + p] -= g;
+            }
+        };
+
+        for (const Resistor& r : resistors)
+            stamp(r.a, r.b, 1.0 / r.ohms);
+
+        // The companion model of each capacitor for one implicit midpoint step.
+        if (dt > 0.0)
+            for (const Capacitor& c : capacitors)
+                stamp(c.a, c.b, 2.0 * c.farads / dt);
+
+        // Each ideal op-amp adds an unknown output current, and a row
+        // constraining its input voltages to be equal.
+        const int nn = static_cast<int>(nodeNames.size());
+        for (std::size_t k = 0; k < opamps.size(); ++k)
+        {
+            const OpAmp& u = opamps[k];
+            const int col = nn + static_cast<int>(k);
+            a[u.out*n + col] += 1.0;
+            if (u.inPlus  >= 0) a[col*n + u.inPlus ] += 1.0;
+            if (u.inMinus >= 0) a[col*n + u.inMinus] -= 1.0;
+        }
+    }
+
+
+    double NodalCircuit::voltage(int index) const
+    {
+        if (index < 0)
+            return 0.0;
+
+        const std::size_t ns = acc.size();
+        double v = oddSteps ? -base[index] : base[index];
+        for (std::size_t j = 0; j < ns; ++j)
+            v += Mn[index*ns + j] * acc[j];
+        return v;
+    }
+
+
+    void NodalCircuit::resetNodes(const double *voltages)
+    {
+        base.assign(voltages, voltages + nodeNames.size());
+        std::fill(acc.begin(), acc.end(), 0.0);
+        oddSteps = false;
+    }
+
+
+    bool NodalCircuit::prepare(double dt)
+    {
+        // The node accumulator depends on the old matrices, so fold it in first.
+        if (cachedDt > 0.0)
+        {
+            std::vector<double> voltages(nodeNames.size());
+            for (std::size_t k = 0; k < voltages.size(); ++k)
+                voltages[k] = voltage(static_cast<int>(k));
+            resetNodes(voltages.data());
+        }
+
+        // Linear system for the midpoint voltages u:  A*u = B*cap - E*id
+        // where B holds the capacitor companion sources and E the diode incidence.
+        const int n = unknowns();
+        const int nn = static_cast<int>(nodeNames.size());
+        const int nc = static_cast<int>(capacitors.size());
+        const int nd = static_cast<int>(diodes.size());
+
+        std::vector<double> lu(n*n);
+        stampLinear(lu, n, dt);
+        std::vector<int> perm;
+        if (!LuFactor(lu, perm, n))
+            return false;
+
+        // X = inv(A)*B and Y = inv(A)*E, one column at a time.
+        std::vector<double> X(n*nc);
+        std::vector<double> Y(n*nd);
+        std::vector<double> col(n);
+        for (int j = 0; j < nc; ++j)
+        {
+            const Capacitor& c = capacitors[j];
+            const double g = 2.0 * c.farads / dt;
+            std::fill(col.begin(), col.end(), 0.0);
+            if (c.a >= 0) col[c.a] += g;
+            if (c.b >= 0) col[c.b] -= g;
+            LuSolve(lu, perm, n, col.data());
+            for (int i = 0; i < n; ++i)
+                X[i*nc + j] = col[i];
+        }
+        for (int j = 0; j < nd; ++j)
+        {
+            const Diode& d = diodes[j];
+            std::fill(col.begin(), col.end(), 0.0);
+            if (d.a >= 0) col[d.a] += 1.0;
+            if (d.b >= 0) col[d.b] -= 1.0;
+            LuSolve(lu, perm, n, col.data());
+            for (int i = 0; i < n; ++i)
+                Y[i*nd + j] = col[i];
+        }
+
+        // Reduce to the voltages the simulation needs: across each diode,
+        // across each capacitor, and at each node.
+        auto across = [](const std::vector<double>& M, int cols, int a, int b, int j)
+        {
+            return ((a >= 0) ? M[a*cols + j] : 0.0) - ((b >= 0) ? M[b*cols + j] : 0.0);
+        };
+
+        K.assign(nd*nc, 0.0);
+        Z.assign(nd*nd, 0.0);
+        for (int r = 0; r < nd; ++r)
+        {
+            for (int j = 0; j < nc; ++j)
+                K[r*nc + j] = across(X, nc, diodes[r].a, diodes[r].b, j);
+            for (int j = 0; j < nd; ++j)
+                Z[r*nd + j] = across(Y, nd, diodes[r].a, diodes[r].b, j);
+        }
+
+        // Rows of [X Y] for each capacitor and each node, to multiply by the source vector.
+        const int ns = nc + nd;
+        Mc.assign(nc*ns, 0.0);
+        for (int r = 0; r < nc; ++r)
+        {
+            for (int j = 0; j < nc; ++j)
+                Mc[r*ns + j] = across(X, nc, capacitors[r].a, capacitors[r].b, j);
+            for (int j = 0; j < nd; ++j)
+                Mc[r*ns + nc + j] = across(Y, nd, capacitors[r].a, capacitors[r].b, j);
+        }
+
+        Mn.assign(nn*ns, 0.0);
+        for (int r = 0; r < nn; ++r)
+        {
+            for (int j = 0; j < nc; ++j)
+                Mn[r*ns + j] = X[r*nc + j];
+            for (int j = 0; j < nd; ++j)
+                Mn[r*ns + nc + j] = Y[r*nd + j];
+        }
+
+        cachedDt = dt;
+        return true;
+    }
+
+
+    bool NodalCircuit::operatingPoint()
+    {
+        // Solve for the node voltages with each capacitor held at its voltage,
+        // as if by an ideal voltage source. Newton's method handles the diodes.
+        const int n = unknowns();
+        const int nc = static_cast<int>(capacitors.size());
+        const int m = n + nc;
+
+        std::vector<double> u(m, 0.0);
+        std::vector<double> a(m*m);
+        std::vector<double> rhs(m);
+        std::vector<int> perm;
+        for (int iter = 0; iter < 200; ++iter)
+        {
+            std::fill(a.begin(), a.end(), 0.0);
+            std::fill(rhs.begin(), rhs.end(), 0.0);
+            stampLinear(a, m, 0.0);
+            for (int j = 0; j < nc; ++j)
+            {
+                const Capacitor& c = capacitors[j];
+                const int row = n + j;
+                if (c.a >= 0) { a[c.a*m + row] += 1.0;  a[row*m + c.a] += 1.0; }
+                if (c.b >= 0) { a[c.b*m + row] -= 1.0;  a[row*m + c.b] -= 1.0; }
+                rhs[row] = cap[j];
+            }
+            for (const Diode& d : diodes)
+            {
+                const double v = ((d.a >= 0) ? u[d.a] : 0.0) - ((d.b >= 0) ? u[d.b] : 0.0);
+                double g;
+                const double i = d.model.current(v, g);
+                const double offset = i - g*v;
+                if (d.a >= 0) { a[d.a*m + d.a] += g;  rhs[d.a] -= offset; }
+                if (d.b >= 0) { a[d.b*m + d.b] += g;  rhs[d.b] += offset; }
+                if (d.a >= 0 && d.b >= 0) { a[d.a*m + d.b] -= g;  a[d.b*m + d.a] -= g; }
+            }
+            if (!LuFactor(a, perm, m))
+                return false;
+            LuSolve(a, perm, m, rhs.data());
+
+            // Limit how far each step can move a diode voltage, so the exponential cannot overshoot.
+            double scale = 1.0;
+            for (const Diode& d : diodes)
+            {
+                const double step = std::abs(
+                    (((d.a >= 0) ? rhs[d.a] - u[d.a] : 0.0) - ((d.b >= 0) ? rhs[d.b] - u[d.b] : 0.0)));
+                if (step*scale > 0.1)
+                    scale = 0.1 / step;
+            }
+            double change = 0.0;
+            for (int i = 0; i < m; ++i)
+            {
+                const double du = scale * (rhs[i] - u[i]);
+                u[i] += du;
+                change = std::max(change, std::abs(du));
+            }
+            if (change < 1.0e-12)
+            {
+                resetNodes(u.data());
+                for (std::size_t k = 0; k < diodes.size(); ++k)
+                {
+                    const Diode& d = diodes[k];
+                    vd[k] = vdLast[k] = voltage(d.a) - voltage(d.b);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    bool NodalCircuit::initialize()
+    {
+        for (std::size_t j = 0; j < capacitors.size(); ++j)
+            cap[j] = capacitors[j].initialVoltage;
+        return operatingPoint();
+    }
+
+
+    bool NodalCircuit::setInitialVoltage(const char *capacitorName, double volts)
+    {
+        for (Capacitor& c : capacitors)
+        {
+            if (!strcasecmp(c.name.c_str(), capacitorName))
+            {
+                c.initialVoltage = volts;
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    int NodalCircuit::findNode(const char *name) const
+    {
+        for (std::size_t k = 0; k < nodeNames.size(); ++k)
+            if (!strcasecmp(nodeNames[k].c_str(), name))
+                return static_cast<int>(k);
+        return -1;
+    }
+
+
+    int NodalCircuit::update(double dt)
+    {
+        if (dt != cachedDt && !prepare(dt))
+            return 0;
+
+        const int nc = static_cast<int>(capacitors.size());
+        const int nd = static_cast<int>(diodes.size());
+
+        // Newton's method for the diode voltages at the middle of the step:
+        //     F(v) = v + Z*id(v) - vlin = 0,   J = I + Z*diag(gd)
+        // starting from a linear extrapolation of the previous steps.
+        for (int r = 0; r < nd; ++r)
+        {
+            double sum = 0.0;
+            for (int j = 0; j < nc; ++j)
+                sum += K[r*nc + j] * cap[j];
+            vlin[r] = sum;
+            const double guess = 2*vd[r] - vdLast[r];
+            vdLast[r] = vd[r];
+            vd[r] = guess;
+        }
+
+        const double tolerance = 1.0e-12;        // one picovolt
+        const double toleranceSquared = tolerance * tolerance;
+        int iter = 0;
+        if (nd > 0)
+        {
+            while (true)
+            {
+                ++iter;
+                for (int r = 0; r < nd; ++r)
+                    id[r] = diodes[r].model.current(vd[r], gd[r]);
+
+                for (int r = 0; r < nd; ++r)
+                {
+                    double f = vd[r] - vlin[r];
+                    for (int j = 0; j < nd; ++j)
+                    {
+                        f += Z[r*nd + j] * id[j];
+                        jac[r*nd + j] = Z[r*nd + j] * gd[j] + ((r == j) ? 1.0 : 0.0);
+                    }
+                    delta[r] = -f;
+                }
+
+                if (nd == 1)
+                {
+                    delta[0] /= jac[0];
+                    vd[0] += delta[0];
+                    if (delta[0]*delta[0] < toleranceSquared || iter >= iterationLimit)
+                    {
+                        id[0] += gd[0] * delta[0];
+                        break;
+                    }
+                    continue;
+                }
+
+                // Gaussian elimination with partial pivoting; the system is tiny.
+                for (int k = 0; k < nd; ++k)
+                {
+                    int p = k;
+                    for (int i = k+1; i < nd; ++i)
+                        if (std::abs(jac[i*nd + k]) > std::abs(jac[p*nd + k]))
+                            p = i;
+                    if (p != k)
+                    {
+                        for (int j = 0; j < nd; ++j)
+                            std::swap(jac[k*nd + j], jac[p*nd + j]);
+                        std::swap(delta[k], delta[p]);
+                    }
+                    for (int i = k+1; i < nd; ++i)
+                    {
+                        const double f = jac[i*nd + k] / jac[k*nd + k];
+                        for (int j = k+1; j < nd; ++j)
+                            jac[i*nd + j] -= f * jac[k*nd + j];
+                        delta[i] -= f * delta[k];
+                    }
+                }
+                double variance = 0.0;
+                for (int k = nd-1; k >= 0; --k)
+                {
+                    double sum = delta[k];
+                    for (int j = k+1; j < nd; ++j)
+                        sum -= jac[k*nd + j] * delta[j];
+                    delta[k] = sum / jac[k*nd + k];
+                    variance += delta[k] * delta[k];
+                }
+
+                for (int r = 0; r < nd; ++r)
+                    vd[r] += delta[r];
+
+                if (variance < toleranceSquared || iter >= iterationLimit)
+                {
+                    // Apply the final correction to the currents through the linear model.
+                    for (int r = 0; r < nd; ++r)
+                        id[r] += gd[r] * delta[r];
+                    break;
+                }
+            }
+        }
+
+        // The midpoint voltages follow from the cached matrices;
+        // extrapolate them to the end of the step.
+        const int ns = nc + nd;
+        double *s = source.data();
+        for (int j = 0; j < nc; ++j)
+            s[j] = cap[j];
+        for (int j = 0; j < nd; ++j)
+            s[nc + j] = -id[j];
+
+        // Each node voltage is 2*Mn*s minus its value at the start of the step.
+        // Rather than update every node, accumulate that alternating sum in the
+        // short source vector, and let voltage() multiply it out on demand.
+        for (int j = 0; j < ns; ++j)
+            acc[j] = 2*s[j] - acc[j];
+        oddSteps = !oddSteps;
+
+        const double *m = Mc.data();
+        for (int r = 0; r < nc; ++r, m += ns)
+        {
+            double sm = 0.0;
+            for (int j = 0; j < ns; ++j)
+                sm += m[j] * s[j];
+            cap[r] = 2*sm - cap[r];
+        }
+
+        return iter;
+    }
+
+
+    // Parse a number with an optional SPICE scale factor (f, p, n, u, m, k, meg, g, t).
+    // Any letters after the scale factor, such as units, are ignored.
+    static bool ParseValue(const std::string& token, double& value)
+    {
+        const char *text = token.c_str();
+        char *end;
+        value = std::strtod(text, &end);
+        if (end == text)
+            return false;
+
+        if (!strncasecmp(end, "meg", 3))
+            value *= 1.0e+6;
+        else switch (std::tolower(static_cast<unsigned char>(*end)))
+        {
+        case 'f':   value *= 1.0e-15;   break;
+        case 'p':   value *= 1.0e-12;   break;
+        case 'n':   value *= 1.0e-9;    break;
+        case 'u':   value *= 1.0e-6;    break;
+        case 'm':   value *= 1.0e-3;    break;
+        case 'k':   value *= 1.0e+3;    break;
+        case 'g':   value *= 1.0e+9;    break;
+        case 't':   value *= 1.0e+12;   break;
+        }
+        return std::isfinite(value);
+    }
+
+
+    std::optional<NodalCircuit> ParseNetlist(const char *text, std::string& error)
+    {
+        NodalCircuit circuit;
+
+        auto nodeIndex = [&circuit](const std::string& name) -> int
+        {
+            if (name == "0" || !strcasecmp(name.c_str(), "gnd"))
+                return -1;
+            int index = circuit.findNode(name.c_str());
+            if (index < 0)
+            {
+                index = static_cast<int>(circuit.nodeNames.size());
+                circuit.nodeNames.push_back(name);
+            }
+            return index;
+        };
+
+        std::istringstream input(text ? text : "");
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(input, line))
+        {
+            ++lineNumber;
+            const std::string where = "line " + std::to_string(lineNumber) + ": ";
+
+            const std::size_t comment = line.find(';');
+            if (comment != std::string::npos)
+                line.erase(comment);
+
+            std::istringstream words(line);
+            std::vector<std::string> tokens;
+            std::string token;
+            while (words >> token)
+                tokens.push_back(token);
+
+            if (tokens.empty() || tokens[0][0] == '*')
+                continue;
+
+            if (tokens[0][0] == '.')
+            {
+                if (!strcasecmp(tokens[0].c_str(), ".end"))
+                    break;
+                error = where + "unsupported command '" + tokens[0] + "'";
+                return std::nullopt;
+            }
+
+            // Split optional NAME=value parameters from the positional fields.
+            std::vector<std::string> fields;
+            std::vector<std::pair<std::string, double>> params;
+            for (const std::string& t : tokens)
+            {
+                const std::size_t eq = t.find('=');
+                if (eq == std::string::npos)
+                {
+                    fields.push_back(t);
+                    continue;
+                }
+                double value;
+                if (!ParseValue(t.substr(eq+1), value))
+                {
+                    error = where + "invalid value in '" + t + "'";
+                    return std::nullopt;
+                }
+                params.emplace_back(t.substr(0, eq), value);
+            }
+
+            if (fields.empty())
+            {
+                error = where + "missing element name";
+                return std::nullopt;
+            }
+
+            const std::string& name = fields[0];
+            const char kind = static_cast<char>(std::toupper(static_cast<unsigned char>(name[0])));
+            auto param = [&params](const char *key, double& value)
+            {
+                for (const auto& p : params)
+                {
+                    if (!strcasecmp(p.first.c_str(), key))
+                    {
+                        value = p.second;
+                        return true;
+                    }
+                }
+                return false;
+            };
+
+            if (kind == 'R' || kind == 'C')
+            {
+                double value;
+                if (fields.size() != 4 || !ParseValue(fields[3], value) || !(value > 0.0))
+                {
+                    error = where + "expected " + name + " <node> <node> <positive value>";
+                    return std::nullopt;
+                }
+                const int a = nodeIndex(fields[1]);
+                const int b = nodeIndex(fields[2]);
+                if (kind == 'R')
+                {
+                    circuit.resistors.push_back({{name, a, b}, value});
+                }
+                else
+                {
+                    double ic = 0.0;
+                    param("IC", ic);
+                    circuit.capacitors.push_back({{name, a, b}, value, ic});
+                }
+            }
+            else if (kind == 'D')
+            {
+                if (fields.size() != 3)
+                {
+                    error = where + "expected " + name + " <anode> <cathode> [A=a] [B=b] [C=c]";
+                    return std::nullopt;
+                }
+                DiodeModel model;
+                param("A", model.A);
+                param("B", model.B);
+                param("C", model.C);
+                model.expC = std::exp(model.C);
+                circuit.diodes.push_back({{name, nodeIndex(fields[1]), nodeIndex(fields[2])}, model});
+            }
+            else if (kind == 'U')
+            {
+                if (fields.size() != 4)
+                {
+                    error = where + "expected " + name + " <out> <in+> <in->";
+                    return std::nullopt;
+                }
+                const int out = nodeIndex(fields[1]);
+                if (out < 0)
+                {
+                    error = where + "op-amp output cannot be ground";
+                    return std::nullopt;
+                }
+                circuit.opamps.push_back({name, out, nodeIndex(fields[2]), nodeIndex(fields[3])});
+            }
+            else
+            {
+                error = where + "unknown element '" + name + "'";
+                return std::nullopt;
+            }
+        }
+
+        if (circuit.nodeNames.empty())
+        {
+            error = "netlist has no nodes";
+            return std::nullopt;
+        }
+
+        const std::size_t nd = circuit.diodes.size();
+        const std::size_t nc = circuit.capacitors.size();
+        circuit.cap.resize(nc);
+        circuit.source.resize(nc + nd);
+        circuit.base.resize(circuit.nodeNames.size());
+        circuit.acc.resize(nc + nd);
+        circuit.vd.resize(nd);
+        circuit.vdLast.resize(nd);
+        circuit.vlin.resize(nd);
+        circuit.id.resize(nd);
+        circuit.gd.resize(nd);
+        circuit.delta.resize(nd);
+        circuit.jac.resize(nd*nd);
+
+        if (!circuit.prepare(1.0 / 44100.0))
+        {
+            error = "circuit matrix is singular: check for floating nodes and op-amp loops";
+            return std::nullopt;
+        }
+
+        if (!circuit.initialize())
+        {
+            error = "could not solve for the initial operating point";
+            return std::nullopt;
+        }
+
+        return circuit;
+    }
+}
@@ -0,0 +1,132 @@
+/*
+    NodalCircuit.hpp  -  Don Cross <cosinekitty@gmail.com>
+
+    A small modified nodal analysis (MNA) engine for simulating circuits
+    built from resistors, capacitors, ideal op-amps, and exponential diodes,
+    loaded from a SPICE-like netlist (see jerk.cir for the format).
+
+    Each sample is one implicit midpoint step: the circuit is solved at the
+    middle of the time interval, with each capacitor replaced by its companion
+    model (conductance 2C/dt in parallel with a current source holding its
+    starting voltage). Everything except the diodes is linear, so the MNA matrix
+    of the linear part is LU-factored once per time step size, and reduced to
+    matrices that map capacitor voltages and diode currents to node voltages.
+    Per sample, only the diode stamps change: Newton's method solves a system
+    with one unknown per diode, then the node and capacitor voltages follow
+    from the cached matrices.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace Analog
+{
+    // Diode current I(V) = exp(A*V^2 + B*V + C) - exp(C), same form as ExactDiode in JerkCircuit.hpp.
+    struct DiodeModel
+    {
+        double A = -26.714774051906932;
+        double B = +112.53225596759907;
+        double C = -115.91134470261159;
+        double expC = std::exp(C);
+
+        double current(double voltage, double& conductance) const
+        {
+            const double e = std::exp(A*voltage*voltage + B*voltage + C);
+            conductance = (2*A*voltage + B) * e;
+            return e - expC;
+        }
+    };
+
+
+    class NodalCircuit
+    {
+    private:
+        friend std::optional<NodalCircuit> ParseNetlist(const char *text, std::string& error);
+
+        struct Branch
+        {
+            std::string name;
+            int a;      // positive node index, or -1 for ground
+            int b;      // negative node index, or -1 for ground
+        };
+
+        struct Resistor : Branch { double ohms; };
+        struct Capacitor : Branch { double farads; double initialVoltage; };
+        struct Diode : Branch { DiodeModel model; };
+        struct OpAmp
+        {
+            std::string name;
+            int out;
+            int inPlus;
+            int inMinus;
+        };
+
+        std::vector<std::string> nodeNames;     // excludes ground
+        std::vector<Resistor> resistors;
+        std::vector<Capacitor> capacitors;
+        std::vector<Diode> diodes;
+        std::vector<OpAmp> opamps;
+
+        // Matrices cached for the current time step (row-major).
+        double cachedDt = 0;
+        std::vector<double> K;      // diodes x capacitors: linear part of the diode voltages
+        std::vector<double> Z;      // diodes x diodes: diode voltage drop per unit diode current
+        std::vector<double> Mc;     // capacitors x sources: midpoint capacitor voltages
+        std::vector<double> Mn;     // nodes x sources: midpoint node voltages
+
+        // Simulation state.
+        std::vector<double> cap;    // capacitor voltages at the start of the next step
+        std::vector<double> base;   // node voltages when the accumulator was last reset
+        std::vector<double> acc;    // alternating sum of twice the source vector; see update()
+        bool oddSteps = false;      // whether an odd number of steps have been accumulated
+        std::vector<double> vd;     // diode voltages at the middle of the last step
+        std::vector<double> vdLast; // diode voltages at the middle of the step before that
+
+        // Per-sample scratch space.
+        std::vector<double> vlin;
+        std::vector<double> id;
+        std::vector<double> gd;
+        std::vector<double> jac;
+        std::vector<double> delta;
+        std::vector<double> source; // capacitor voltages, then negated diode currents
+
+        int unknowns() const { return static_cast<int>(nodeNames.size() + opamps.size()); }
+        void stampLinear(std::vector<double>& a, int n, double dt) const;
+        bool prepare(double dt);
+        bool operatingPoint();
+        void resetNodes(const double *voltages);
+
+    public:
+        int iterationLimit = 5;
+
+        // Restore every capacitor to its initial voltage and solve for the node voltages.
+        // Returns false if the operating point does not converge.
+        bool initialize();
+
+        // Change a capacitor's initial voltage (the IC= value in the netlist).
+        // Takes effect at the next call to initialize().
+        bool setInitialVoltage(const char *capacitorName, double volts);
+
+        // Advance the circuit by `dt` seconds. Returns the number of Newton iterations used.
+        int update(double dt);
+
+        // Index of a named node, or -1 if there is no such node (ground included).
+        int findNode(const char *name) const;
+        double voltage(int index) const;
+
+        std::size_t nodeCount() const { return nodeNames.size(); }
+        std::size_t capacitorCount() const { return capacitors.size(); }
+        std::size_t diodeCount() const { return diodes.size(); }
+        std::size_t opampCount() const { return opamps.size(); }
+    };
+
+
+    // Parse a netlist and prepare it for simulation.
+    // On failure, returns std::nullopt and describes the problem in `error`.
+    std::optional<NodalCircuit> ParseNetlist(const char *text, std::string& error);
+}
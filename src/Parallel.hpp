@@ -0,0 +1,51 @@
+/*
+    Parallel.hpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Runs many independent jobs across all the CPU cores.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace Analog
+{
+    inline unsigned DefaultThreadCount()
+    {
+        const unsigned n = std::thread::hardware_concurrency();
+        return (n > 0) ? n : 1;
+    }
+
+
+    // Call job(index, worker) for every index in [0, count), using `threads` threads.
+    // `worker` is in [0, threads), so a job can use per-thread scratch space.
+    // Each thread claims the next unclaimed index from a shared counter,
+    // so threads that get short jobs go on to take more of them,
+    // and the work balances itself even when job costs vary widely.
+    template <typename job_t>
+    void ParallelFor(std::size_t count, unsigned threads, job_t job)
+    {
+        std::atomic<std::size_t> next{0};
+        auto run = [&next, &job, count](unsigned worker)
+        {
+            for (std::size_t i = next++; i < count; i = next++)
+                job(i, worker);
+        };
+
+        if (threads <= 1 || count <= 1)
+        {
+            run(0);
+            return;
+        }
+
+        std::vector<std::thread> pool;
+        for (unsigned worker = 1; worker < threads; ++worker)
+            pool.emplace_back(run, worker);
+        run(0);
+        for (std::thread& t : pool)
+            t.join();
+    }
+}
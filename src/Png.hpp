@@ -0,0 +1,145 @@
+/*
+    Png.hpp  -  Don Cross <cosinekitty@gmail.com>
+
+    A minimal PNG writer for 8-bit RGB images, with no library dependencies.
+    The image data is stored uncompressed (deflate "stored" blocks), which makes
+    the files larger than they need to be but keeps the writer trivial.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace Analog
+{
+    class PngChunkWriter
+    {
+    private:
+        FILE *outfile;
+        std::uint32_t crcTable[256];
+        std::uint32_t crc = 0;
+
+    public:
+        explicit PngChunkWriter(FILE *f)
+            : outfile(f)
+        {
+            for (std::uint32_t n = 0; n < 256; ++n)
+            {
+                std::uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+                crcTable[n] = c;
+            }
+        }
+
+        void bytes(const std::uint8_t *data, std::size_t length)
+        {
+            fwrite(data, 1, length, outfile);
+            for (std::size_t i = 0; i < length; ++i)
+                crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+
+        void u32(std::uint32_t x)
+        {
+            const std::uint8_t b[4] = {
+                static_cast<std::uint8_t>(x >> 24), static_cast<std::uint8_t>(x >> 16),
+                static_cast<std::uint8_t>(x >> 8), static_cast<std::uint8_t>(x)
+            };
+            bytes(b, 4);
+        }
+
+        void begin(const char type[4], std::uint32_t length)
+        {
+            u32(length);            // the length is not covered by the CRC...
+            crc = 0xffffffffu;      // ...so start the CRC after it
+            bytes(reinterpret_cast<const std::uint8_t *>(type), 4);
+        }
+
+        void end()
+        {
+            const std::uint32_t c = crc ^ 0xffffffffu;
+            u32(c);
+        }
+    };
+
+
+    // Write `rgb` (height rows of width*3 bytes, top row first) as a PNG file.
+    inline bool SavePng(const char *filename, int width, int height, const std::vector<std::uint8_t>& rgb)
+    {
+        const std::size_t rowBytes = 1 + 3*static_cast<std::size_t>(width);     // filter byte + pixels
+        const std::size_t rawBytes = rowBytes * height;
+        const std::size_t maxBlock = 0xffff;
+        const std::size_t blocks = (rawBytes + maxBlock - 1) / maxBlock;
+        const std::size_t idatBytes = 2 + 5*blocks + rawBytes + 4;
+        if (width <= 0 || height <= 0 || rgb.size() != 3*static_cast<std::size_t>(width)*height || idatBytes > 0x7fffffffu)
+        {
+            printf("ERROR: Invalid image size for PNG: %d x %d\n", width, height);
+            return false;
+        }
+
+        FILE *outfile = fopen(filename, "wb");
+        if (outfile == nullptr)
+        {
+            printf("ERROR: Cannot open output file: %s\n", filename);
+            return false;
+        }
+
+        static const std::uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        fwrite(signature, 1, sizeof(signature), outfile);
+
+        PngChunkWriter png(outfile);
+        png.begin("IHDR", 13);
+        png.u32(static_cast<std::uint32_t>(width));
+        png.u32(static_cast<std::uint32_t>(height));
+        const std::uint8_t format[5] = {8, 2, 0, 0, 0};    // 8-bit RGB, deflate, no filter, no interlace
+        png.bytes(format, sizeof(format));
+        png.end();
+
+        // The zlib stream: header, stored deflate blocks of the filtered rows, Adler-32.
+        png.begin("IDAT", static_cast<std::uint32_t>(idatBytes));
+        const std::uint8_t zlibHeader[2] = {0x78, 0x01};
+        png.bytes(zlibHeader, sizeof(zlibHeader));
+        std::uint32_t a = 1, b = 0;
+        std::vector<std::uint8_t> block;
+        block.reserve(maxBlock);
+        std::size_t written = 0;
+        for (int y = 0; y < height; ++y)
+        {
+            for (std::size_t i = 0; i < rowBytes; ++i)
+            {
+                const std::uint8_t byte = (i == 0) ? 0 : rgb[(static_cast<std::size_t>(y)*width*3) + i - 1];
+                block.push_back(byte);
+                a = (a + byte) % 65521;
+                b = (b + a) % 65521;
+                if (block.size() == maxBlock || written + block.size() == rawBytes)
+                {
+                    const std::uint16_t len = static_cast<std::uint16_t>(block.size());
+                    written += block.size();
+                    const std::uint8_t head[5] = {
+                        static_cast<std::uint8_t>(written == rawBytes ? 1 : 0),     // BFINAL, BTYPE = stored
+                        static_cast<std::uint8_t>(len), static_cast<std::uint8_t>(len >> 8),
+                        static_cast<std::uint8_t>(~len), static_cast<std::uint8_t>((~len) >> 8)
+                    };
+                    png.bytes(head, sizeof(head));
+                    png.bytes(block.data(), block.size());
+                    block.clear();
+                }
+            }
+        }
+        png.u32((b << 16) | a);
+        png.end();
+
+        png.begin("IEND", 0);
+        png.end();
+
+        const bool ok = !ferror(outfile);
+        if (fclose(outfile) != 0 || !ok)
+        {
+            printf("ERROR: Failed writing output file: %s\n", filename);
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cmath>
+
+// Orthographic projection of oscillator outputs onto the viewing plane,
+// shared by the live Plotter and the headless density renderer.
+
+const double MIN_VOLTAGE = -5.5;
+const double MAX_VOLTAGE = +5.5;
+
+struct PlotVector
+{
+    double nx;
+    double ny;
+    double nz;
+
+    PlotVector(double _nx, double _ny, double _nz)
+        : nx(_nx)
+        , ny(_ny)
+        , nz(_nz)
+        {}
+
+    void rotateX(double c, double s)
+    {
+        double ry = c*ny - s*nz;
+        double rz = s*ny + c*nz;
+        ny = ry;
+        nz = rz;
+    }
+
+    void rotateY(double c, double s)
+    {
+        double rx = c*nx - s*nz;
+        double rz = s*nx + c*nz;
+        nx = rx;
+        nz = rz;
+    }
+};
+
+class PlotView
+{
+private:
+    PlotVector xdir{1.0, 0.0, 0.0};
+    PlotVector ydir{0.0, 1.0, 0.0};
+
+public:
+    void rotateX(double radians)
+    {
+        double c = std::cos(radians);
+        double s = std::sin(radians);
+        xdir.rotateX(c, s);
+        ydir.rotateX(c, s);
+    }
+
+    void rotateY(double radians)
+    {
+        double c = std::cos(radians);
+        double s = std::sin(radians);
+        xdir.rotateY(c, s);
+        ydir.rotateY(c, s);
+    }
+
+    // Map a point to fractions (u, v) of the view's width and height:
+    // [0, 1] across MIN_VOLTAGE..MAX_VOLTAGE, with v increasing downward.
+    template <typename real_t>
+    void project(real_t vx, real_t vy, real_t vz, real_t& u, real_t& v) const
+    {
+        const real_t x = vx*real_t(xdir.nx) + vy*real_t(xdir.ny) + vz*real_t(xdir.nz);
+        const real_t y = vx*real_t(ydir.nx) + vy*real_t(ydir.ny) + vz*real_t(ydir.nz);
+        u = (x - real_t(MIN_VOLTAGE)) / real_t(MAX_VOLTAGE - MIN_VOLTAGE);
+        v = (real_t(MAX_VOLTAGE) - y) / real_t(MAX_VOLTAGE - MIN_VOLTAGE);
+    }
+};
@@ -0,0 +1,198 @@
+/*
+    RangeTable.hpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Output ranges of a chaotic oscillator measured at a grid of knob positions,
+    so the remapping to [-AMPLITUDE, +AMPLITUDE] can follow the knob.
+    Written by the calibrate tool; loaded by ChaoticOscillator::setRangeTable().
+    The file can also hold the maximum stable time step found by the stepsearch tool.
+
+    File format (text, one table per oscillator kind, e.g. "ruck.range"):
+
+        # comment lines start with '#'
+        kind ruck
+        max_dt 0.0021
+        knob xmin xmax ymin ymax zmin zmax
+        -1.000 -9.87 9.91 -5.43 5.40 0.00 15.02
+        ...
+
+    The "max_dt" line is optional, and so are the rows, but not both.
+    The "knob" line is a column header. Each row after it holds the raw
+    (unscaled) ranges measured at one knob position, in increasing knob order.
+*/
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+namespace Analog
+{
+    struct RangeRow
+    {
+        double knob = 0.0;
+        double xmin = 0.0;
+        double xmax = 0.0;
+        double ymin = 0.0;
+        double ymax = 0.0;
+        double zmin = 0.0;
+        double zmax = 0.0;
+    };
+
+
+    class RangeTable
+    {
+    private:
+        std::vector<RangeRow> rows;
+
+        static double lerp(double a, double b, double f) { return a + f*(b - a); }
+
+    public:
+        double maxStep = 0.0;       // 0 = not measured
+
+        bool empty() const { return rows.empty(); }
+        std::size_t size() const { return rows.size(); }
+        const RangeRow& row(std::size_t i) const { return rows[i]; }
+
+        // Rows must be added in strictly increasing knob order.
+        bool append(const RangeRow& r)
+        {
+            if (!rows.empty() && r.knob <= rows.back().knob)
+                return false;
+            if (r.xmax <= r.xmin || r.ymax <= r.ymin || r.zmax <= r.zmin)
+                return false;
+            rows.push_back(r);
+            return true;
+        }
+
+        // Ranges at an arbitrary knob position, interpolated linearly
+        // between the two nearest rows and held constant past either end.
+        RangeRow lookup(double knob) const
+        {
+            if (rows.empty())
+                return RangeRow{};
+
+            if (knob <= rows.front().knob)
+                return rows.front();
+
+            if (knob >= rows.back().knob)
+                return rows.back();
+
+            std::size_t i = 1;
+            while (rows[i].knob < knob)
+                ++i;
+
+            const RangeRow& a = rows[i-1];
+            const RangeRow& b = rows[i];
+            const double f = (knob - a.knob) / (b.knob - a.knob);
+            RangeRow r;
+            r.knob = knob;
+            r.xmin = lerp(a.xmin, b.xmin, f);
+            r.xmax = lerp(a.xmax, b.xmax, f);
+            r.ymin = lerp(a.ymin, b.ymin, f);
+            r.ymax = lerp(a.ymax, b.ymax, f);
+            r.zmin = lerp(a.zmin, b.zmin, f);
+            r.zmax = lerp(a.zmax, b.zmax, f);
+            return r;
+        }
+    };
+
+
+    inline const char *RangeTableFileName(const char *kind, char *buffer, std::size_t size)
+    {
+        snprintf(buffer, size, "%s.range", kind);
+        return buffer;
+    }
+
+
+    inline bool SaveRangeTable(const char *filename, const char *kind, const RangeTable& table, const char *comment = nullptr)
+    {
+        FILE *outfile = fopen(filename, "wt");
+        if (outfile == nullptr)
+        {
+            printf("ERROR: Cannot open output file: %s\n", filename);
+            return false;
+        }
+
+        if (comment != nullptr)
+            fprintf(outfile, "# %s\n", comment);
+        fprintf(outfile, "kind %s\n", kind);
+        if (table.maxStep > 0.0)
+            fprintf(outfile, "max_dt %lg\n", table.maxStep);
+        fprintf(outfile, "knob xmin xmax ymin ymax zmin zmax\n");
+        for (std::size_t i = 0; i < table.size(); ++i)
+        {
+            const RangeRow& r = table.row(i);
+            fprintf(outfile, "%9.6lf %12.6lf %12.6lf %12.6lf %12.6lf %12.6lf %12.6lf\n",
+                r.knob, r.xmin, r.xmax, r.ymin, r.ymax, r.zmin, r.zmax);
+        }
+
+        const bool ok = !ferror(outfile);
+        if (fclose(outfile) != 0 || !ok)
+        {
+            printf("ERROR: Failed writing output file: %s\n", filename);
+            return false;
+        }
+        return true;
+    }
+
+
+    // Returns std::nullopt if the file does not exist, is malformed,
+    // or holds the table for a different kind of oscillator.
+    // Missing files are silent; any other problem prints an error.
+    inline std::optional<RangeTable> LoadRangeTable(const char *filename, const char *kind)
+    {
+        FILE *infile = fopen(filename, "rt");
+        if (infile == nullptr)
+            return std::nullopt;
+
+        RangeTable table;
+        bool haveKind = false;
+        bool haveHeader = false;
+        bool ok = true;
+        int lnum = 0;
+        char line[200];
+        while (ok && fgets(line, sizeof(line), infile))
+        {
+            ++lnum;
+            char word[64];
+            if (line[0] == '#' || sscanf(line, "%63s", word) != 1)
+                continue;
+
+            if (!strcmp(word, "kind"))
+            {
+                char name[64];
+                haveKind = (sscanf(line, "kind %63s", name) == 1) && !strcmp(name, kind);
+                ok = haveKind;
+            }
+            else if (!strcmp(word, "max_dt"))
+            {
+                ok = haveKind && (sscanf(line, "max_dt %lf", &table.maxStep) == 1) && (table.maxStep > 0.0);
+            }
+            else if (!strcmp(word, "knob"))
+            {
+                haveHeader = true;
+            }
+            else
+            {
+                RangeRow r;
+                ok = haveKind && haveHeader &&
+                    sscanf(line, "%lf %lf %lf %lf %lf %lf %lf", &r.knob, &r.xmin, &r.xmax, &r.ymin, &r.ymax, &r.zmin, &r.zmax) == 7 &&
+                    table.append(r);
+            }
+
+            if (!ok)
+                printf("ERROR(%s line %d): Invalid range table entry for kind '%s'.\n", filename, lnum, kind);
+        }
+        fclose(infile);
+
+        if (!ok || (table.empty() && table.maxStep == 0.0))
+        {
+            if (ok)
+                printf("ERROR: Range table %s has neither rows nor max_dt.\n", filename);
+            return std::nullopt;
+        }
+        return table;
+    }
+}
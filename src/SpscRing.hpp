@@ -0,0 +1,87 @@
+/*
+    SpscRing.hpp  -  Don Cross <cosinekitty@gmail.com>
+
+    A fixed-capacity, wait-free ring buffer for passing values from exactly
+    one producer thread to exactly one consumer thread. Neither side ever
+    blocks or allocates: push() fails when the ring is full and pop() fails
+    when it is empty, and the caller decides whether to retry, wait, or drop.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace Analog
+{
+    template <typename item_t>
+    class SpscRing
+    {
+    private:
+        std::vector<item_t> items;
+        const std::size_t mask;
+
+        // Free-running counters; each is written by one side only.
+        // Keeping them on separate cache lines stops the two threads
+        // from invalidating each other's cache on every operation.
+        alignas(64) std::atomic<std::size_t> head{0};     // next slot to write (producer)
+        alignas(64) std::atomic<std::size_t> tail{0};     // next slot to read (consumer)
+
+        static std::size_t roundUpPowerOfTwo(std::size_t n)
+        {
+            std::size_t p = 1;
+            while (p < n)
+                p <<= 1;
+            return p;
+        }
+
+    public:
+        // The capacity is rounded up to a power of two.
+        explicit SpscRing(std::size_t capacity)
+            : items(roundUpPowerOfTwo(std::max<std::size_t>(capacity, 2)))
+            , mask(items.size() - 1)
+            {}
+
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+
+        std::size_t capacity() const { return items.size(); }
+
+        // Producer only.
+        bool push(const item_t& item)
+        {
+            const std::size_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) == items.size())
+                return false;
+            items[h & mask] = item;
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer only.
+        bool pop(item_t& item)
+        {
+            const std::size_t t = tail.load(std::memory_order_relaxed);
+            if (t == head.load(std::memory_order_acquire))
+                return false;
+            item = items[t & mask];
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer only: pass every item available now to `consume(item)`,
+        // releasing their slots all at once. Returns the number of items.
+        template <typename consume_t>
+        std::size_t drain(consume_t consume)
+        {
+            const std::size_t t = tail.load(std::memory_order_relaxed);
+            const std::size_t h = head.load(std::memory_order_acquire);
+            for (std::size_t i = t; i != h; ++i)
+                consume(items[i & mask]);
+            tail.store(h, std::memory_order_release);
+            return h - t;
+        }
+    };
+}
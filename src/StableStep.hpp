@@ -0,0 +1,170 @@
+/*
+    StableStep.hpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Finds the largest time step at which a chaotic oscillator stays stable:
+    its outputs neither diverge nor shrink much below the swing they have
+    at a step known to be good. (Large steps often damp a chaotic system
+    onto a fixed point or a small cycle, which stays within bounds but is
+    no longer the system being simulated.)
+
+    Starting from a step known to be stable, candidate steps are tried in
+    batches on a thread pool: first growing geometrically to bracket the limit,
+    then splitting the bracket geometrically until its ends are close together.
+    Each batch needs only the smallest candidate that diverges, so once one
+    candidate diverges, every larger candidate in the batch stops early.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include "ChaoticOscillator.hpp"
+#include "Parallel.hpp"
+
+namespace Analog
+{
+    struct StableStepOptions
+    {
+        double start = 1.0 / 44100;     // a time step known to be stable
+        double ceiling = 1.0;           // give up looking for instability past this step
+        long steps = 600 * 44100;       // time steps simulated per trial
+        double limit = AMPLITUDE + 0.1; // any |vx|, |vy|, |vz| beyond this is divergence
+        double coverage = 0.9;          // fraction of the reference swing each output must keep
+        double growth = 2.0;            // ratio between candidates while bracketing
+        double tolerance = 0.01;        // stop when unstable/stable < 1 + tolerance
+        unsigned threads = DefaultThreadCount();
+    };
+
+
+    struct StableStepResult
+    {
+        double stable = 0.0;        // largest step that survived a full trial
+        double unstable = 0.0;      // smallest step that diverged, or 0 if none did below the ceiling
+        int trials = 0;             // trials started
+        int batches = 0;
+    };
+
+
+    // Runs one trial, storing the peak-to-peak swing of each output over the
+    // last quarter of the trial in `swing`. Returns false as soon as the oscillator
+    // diverges; returns true if it survives, or if `abort()` becomes true first.
+    template <typename abort_t>
+    bool StableStepTrial(ChaoticOscillator& osc, double et, const StableStepOptions& options, double swing[3], abort_t abort)
+    {
+        // Integrate at exactly `et`, without the oscillator's own oversampling.
+        osc.setMaxStep(0.0);
+        osc.initialize();
+        const double limit = osc.isTuned ? options.limit : 1000.0;
+        const long tail = options.steps - options.steps/4;
+        double lo[3] = { +limit, +limit, +limit };
+        double hi[3] = { -limit, -limit, -limit };
+        for (long i = 0; i < options.steps; ++i)
+        {
+            osc.update(et);
+            const double v[3] = { osc.vx(), osc.vy(), osc.vz() };
+            const double r = std::max({std::abs(v[0]), std::abs(v[1]), std::abs(v[2])});
+            if (!(r <= limit))      // also catches NaN
+                return false;
+            if (i >= tail)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    lo[c] = std::min(lo[c], v[c]);
+                    hi[c] = std::max(hi[c], v[c]);
+                }
+            }
+            if ((i & 0xfff) == 0 && abort())
+                return true;
+        }
+
+        for (int c = 0; c < 3; ++c)
+            swing[c] = hi[c] - lo[c];
+        return true;
+    }
+
+
+    // Search for the stability limit of the oscillators made by `factory()`,
+    // which must return a std::unique_ptr<ChaoticOscillator> in its initial state.
+    // Returns a result with stable == 0 if even the starting step fails.
+    template <typename factory_t>
+    StableStepResult FindStableStep(factory_t factory, const StableStepOptions& options)
+    {
+        StableStepResult result;
+        const std::size_t batch = std::max(1u, options.threads);
+        std::vector<double> candidate(batch);
+        std::vector<std::unique_ptr<ChaoticOscillator>> pool(batch);
+        for (std::unique_ptr<ChaoticOscillator>& osc : pool)
+            osc = factory();
+
+        // The reference trial at the starting step sets the swing every candidate must keep.
+        double reference[3] {};
+        ++result.trials;
+        if (!StableStepTrial(*pool[0], options.start, options, reference, []() { return false; }))
+            return result;
+
+        // Try every candidate at once; return the index of the smallest
+        // that diverged, or `batch` if all of them survived.
+        auto runBatch = [&]()
+        {
+            std::atomic<std::size_t> firstUnstable{batch};
+            ParallelFor(batch, options.threads, [&](std::size_t i, unsigned worker)
+            {
+                auto abort = [&firstUnstable, i]() { return firstUnstable.load() < i; };
+                if (abort())
+                    return;
+                double swing[3] {};
+                bool stable = StableStepTrial(*pool[worker], candidate[i], options, swing, abort);
+                if (stable && !abort())
+                    for (int c = 0; c < 3; ++c)
+                        if (swing[c] < options.coverage * reference[c])
+                            stable = false;
+                if (!stable)
+                {
+                    std::size_t prev = firstUnstable.load();
+                    while (i < prev && !firstUnstable.compare_exchange_weak(prev, i)) {}
+                }
+            });
+            result.trials += static_cast<int>(batch);
+            ++result.batches;
+            return firstUnstable.load();
+        };
+
+        // Bracket the limit between a stable step and an unstable one.
+        double lo = options.start;
+        double hi = 0.0;
+        while (hi == 0.0 && lo < options.ceiling)
+        {
+            for (std::size_t i = 0; i < batch; ++i)
+                candidate[i] = lo * std::pow(options.growth, i + 1);
+            const std::size_t j = runBatch();
+            if (j < batch)
+            {
+                hi = candidate[j];
+                lo = (j > 0) ? candidate[j-1] : lo;
+            }
+            else
+            {
+                lo = candidate[batch-1];
+            }
+        }
+
+        // Narrow the bracket by splitting it geometrically into batch+1 pieces.
+        while (hi > 0.0 && hi > lo * (1.0 + options.tolerance))
+        {
+            const double ratio = std::pow(hi / lo, 1.0 / (batch + 1));
+            for (std::size_t i = 0; i < batch; ++i)
+                candidate[i] = lo * std::pow(ratio, i + 1);
+            const std::size_t j = runBatch();
+            if (j < batch)
+                hi = candidate[j];
+            if (j > 0)
+                lo = candidate[j-1];
+        }
+
+        result.stable = lo;
+        result.unstable = hi;
+        return result;
+    }
+}
@@ -0,0 +1,202 @@
+/*
+    StateCache.hpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Raw oscillator states known to lie on the attractor, sampled at a grid of
+    knob positions after the initial transient has died away. A new voice can
+    start from a random cached state (see WarmStart) instead of the initial
+    conditions, skipping the settle time. Written by the calibrate tool.
+
+    File format (text, one cache per oscillator kind, e.g. "ruck.states"):
+
+        # comment lines start with '#'
+        kind ruck
+        knob -1.000000
+        x y z
+        x y z
+        ...
+        knob -0.900000
+        ...
+
+    Each "knob" line starts a group of states, one per line, measured at that
+    knob position. Groups appear in increasing knob order.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <vector>
+#include "ChaoticOscillator.hpp"
+
+namespace Analog
+{
+    class StateCache
+    {
+    private:
+        struct Group
+        {
+            double knob;
+            std::vector<OscillatorState> states;
+        };
+
+        std::vector<Group> groups;
+
+    public:
+        // True when there is no state to start from, even if there are groups.
+        bool empty() const
+        {
+            return std::none_of(groups.begin(), groups.end(), [](const Group& g) { return !g.states.empty(); });
+        }
+
+        std::size_t groupCount() const { return groups.size(); }
+        double groupKnob(std::size_t g) const { return groups[g].knob; }
+        const std::vector<OscillatorState>& groupStates(std::size_t g) const { return groups[g].states; }
+
+        // Start a new group of states. Groups must be added in strictly increasing knob order.
+        bool addGroup(double knob)
+        {
+            if (!groups.empty() && knob <= groups.back().knob)
+                return false;
+            groups.push_back(Group{knob, {}});
+            return true;
+        }
+
+        // Add a state to the most recent group.
+        bool add(double x, double y, double z)
+        {
+            if (groups.empty() || !std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z))
+                return false;
+            OscillatorState s;
+            s.x = x;
+            s.y = y;
+            s.z = z;
+            s.knob = groups.back().knob;
+            groups.back().states.push_back(s);
+            return true;
+        }
+
+        // One of the states measured at the knob position nearest `knob`,
+        // chosen by `random`. Returns nullptr if there are none.
+        const OscillatorState *pick(double knob, std::uint64_t random) const
+        {
+            const Group *best = nullptr;
+            for (const Group& g : groups)
+                if (!g.states.empty() && (best == nullptr || std::abs(g.knob - knob) < std::abs(best->knob - knob)))
+                    best = &g;
+            return best ? &best->states[random % best->states.size()] : nullptr;
+        }
+    };
+
+
+    // Move `osc` to a random cached state on its attractor, keeping its knob.
+    // Returns false (leaving `osc` alone) if the cache has no states.
+    inline bool WarmStart(ChaoticOscillator& osc, const StateCache& cache, std::uint64_t random)
+    {
+        const OscillatorState *s = cache.pick(osc.getKnob(), random);
+        if (s == nullptr)
+            return false;
+        osc.setState(s->x, s->y, s->z);
+        return true;
+    }
+
+
+    inline const char *StateCacheFileName(const char *kind, char *buffer, std::size_t size)
+    {
+        snprintf(buffer, size, "%s.states", kind);
+        return buffer;
+    }
+
+
+    inline bool SaveStateCache(const char *filename, const char *kind, const StateCache& cache, const char *comment = nullptr)
+    {
+        FILE *outfile = fopen(filename, "wt");
+        if (outfile == nullptr)
+        {
+            printf("ERROR: Cannot open output file: %s\n", filename);
+            return false;
+        }
+
+        if (comment != nullptr)
+            fprintf(outfile, "# %s\n", comment);
+        fprintf(outfile, "kind %s\n", kind);
+        for (std::size_t g = 0; g < cache.groupCount(); ++g)
+        {
+            fprintf(outfile, "knob %0.6lf\n", cache.groupKnob(g));
+            for (const OscillatorState& s : cache.groupStates(g))
+                fprintf(outfile, "%0.17lg %0.17lg %0.17lg\n", s.x, s.y, s.z);
+        }
+
+        const bool ok = !ferror(outfile);
+        if (fclose(outfile) != 0 || !ok)
+        {
+            printf("ERROR: Failed writing output file: %s\n", filename);
+            return false;
+        }
+        return true;
+    }
+
+
+    // Returns std::nullopt if the file does not exist, is malformed,
+    // or holds states for a different kind of oscillator.
+    // Missing files are silent; any other problem prints an error.
+    inline std::optional<StateCache> LoadStateCache(const char *filename, const char *kind)
+    {
+        FILE *infile = fopen(filename, "rt");
+        if (infile == nullptr)
+            return std::nullopt;
+
+        StateCache cache;
+        bool haveKind = false;
+        bool ok = true;
+        int lnum = 0;
+        char line[200];
+        while (ok && fgets(line, sizeof(line), infile))
+        {
+            ++lnum;
+            char word[64];
+            if (line[0] == '#' || sscanf(line, "%63s", word) != 1)
+                continue;
+
+            if (!strcmp(word, "kind"))
+            {
+                char name[64];
+                haveKind = (sscanf(line, "kind %63s", name) == 1) && !strcmp(name, kind);
+                ok = haveKind;
+            }
+            else if (!strcmp(word, "knob"))
+            {
+                double knob;
+                ok = haveKind && (sscanf(line, "knob %lf", &knob) == 1) && cache.addGroup(knob);
+            }
+            else
+            {
+                double x, y, z;
+                ok = haveKind && (sscanf(line, "%lf %lf %lf", &x, &y, &z) == 3) && cache.add(x, y, z);
+            }
+
+            if (!ok)
+                printf("ERROR(%s line %d): Invalid state cache entry for kind '%s'.\n", filename, lnum, kind);
+        }
+        fclose(infile);
+
+        if (!ok || cache.empty())
+        {
+            if (ok)
+                printf("ERROR: State cache %s has no states.\n", filename);
+            return std::nullopt;
+        }
+        return cache;
+    }
+
+
+    // Load the state cache "<kind>.states" from the current directory, if it exists.
+    inline std::optional<StateCache> LoadStateCache(const char *kind)
+    {
+        char filename[100];
+        return LoadStateCache(StateCacheFileName(kind, filename, sizeof(filename)), kind);
+    }
+}
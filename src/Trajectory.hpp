@@ -0,0 +1,354 @@
+/*
+    Trajectory.hpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Append-only binary recordings of an oscillator's trajectory, written and
+    read through memory-mapped pages. Recording costs a few stores per point:
+    no system calls except once per chunk, and no waiting for the disk,
+    because the kernel writes dirty pages back in its own time. Records are
+    also safe if the recording process crashes, because they are already in
+    the page cache. Playback maps the whole file, so any record out of billions
+    is one address calculation away.
+
+    File layout (native byte order and float format):
+
+        TrajectoryHeader, padded to TRAJECTORY_HEADER_BYTES
+        chunk 0, TRAJECTORY_CHUNK_BYTES long
+        chunk 1
+        ...
+
+    Each chunk starts with a TrajectoryIndex entry, then a table of
+    TRAJECTORY_CHUNK_KNOB_CHANGES knob changes, then up to
+    TRAJECTORY_CHUNK_RECORDS records of float x, y, z. Records are spaced
+    `dt` simulated seconds apart, so record i is always at the same place.
+    Each knob change holds the position of the first record it applies to,
+    counted from the start of the chunk, and the knob position. The first
+    change of every chunk applies to its first record, so playback can find
+    the knob for any record by searching one chunk's table. The header's
+    recordCount is updated after every record; the tail of the last chunk
+    past it is unused.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Analog
+{
+    const char TRAJECTORY_MAGIC[8] = {'A', 'T', 'R', 'A', 'J', 'v', '0', '2'};
+    const std::uint32_t TRAJECTORY_BYTE_ORDER = 0x01020304;
+
+    // Both sizes are multiples of every common page size, so chunks can be mapped individually.
+    const std::size_t TRAJECTORY_HEADER_BYTES = 0x10000;
+    const std::size_t TRAJECTORY_CHUNK_BYTES = 0x100000;
+
+    struct TrajectoryHeader
+    {
+        char magic[8];
+        std::uint32_t byteOrder;        // TRAJECTORY_BYTE_ORDER as written by the recorder
+        std::uint32_t chunkBytes;
+        char kind[16];
+        double knob;                    // knob position when recording started
+        double dt;                      // simulated seconds between records
+        std::uint64_t recordCount;
+    };
+
+    struct TrajectoryIndex
+    {
+        std::uint64_t firstRecord;
+        std::uint32_t count;            // records in this chunk
+        std::uint32_t knobChanges;      // entries used in the chunk's knob change table, at least 1
+    };
+
+    struct TrajectoryKnobChange
+    {
+        std::uint32_t record;           // first record it applies to, counted from the start of the chunk
+        float knob;
+    };
+
+    struct TrajectoryRecord
+    {
+        float x;
+        float y;
+        float z;
+    };
+
+    static_assert(sizeof(TrajectoryHeader) <= TRAJECTORY_HEADER_BYTES);
+
+    // animate records 100 points per simulated second, so at normal speed this allows
+    // more than one knob change per second of recording.
+    // Together with the index entry, the table fills the chunk's first 8 KiB.
+    const std::size_t TRAJECTORY_CHUNK_KNOB_CHANGES = 1022;
+    const std::size_t TRAJECTORY_RECORDS_OFFSET = sizeof(TrajectoryIndex) + TRAJECTORY_CHUNK_KNOB_CHANGES*sizeof(TrajectoryKnobChange);
+
+    static_assert(TRAJECTORY_RECORDS_OFFSET % alignof(TrajectoryRecord) == 0);
+
+    const std::size_t TRAJECTORY_CHUNK_RECORDS = (TRAJECTORY_CHUNK_BYTES - TRAJECTORY_RECORDS_OFFSET) / sizeof(TrajectoryRecord);
+
+    inline std::size_t TrajectoryChunkOffset(std::uint64_t chunk)
+    {
+        return TRAJECTORY_HEADER_BYTES + chunk*TRAJECTORY_CHUNK_BYTES;
+    }
+
+
+    class TrajectoryWriter
+    {
+    private:
+        int fd = -1;
+        TrajectoryHeader *header = nullptr;
+        char *chunk = nullptr;                  // the mapped chunk being filled
+        std::uint64_t chunkNumber = 0;
+        double knob = 0.0;
+
+        TrajectoryIndex& index() { return *reinterpret_cast<TrajectoryIndex *>(chunk); }
+
+        TrajectoryKnobChange *knobChanges() { return reinterpret_cast<TrajectoryKnobChange *>(chunk + sizeof(TrajectoryIndex)); }
+
+        TrajectoryRecord *records() { return reinterpret_cast<TrajectoryRecord *>(chunk + TRAJECTORY_RECORDS_OFFSET); }
+
+        bool mapChunk(std::uint64_t number)
+        {
+            if (chunk != nullptr)
+                munmap(chunk, TRAJECTORY_CHUNK_BYTES);
+            chunk = nullptr;
+
+            // Growing the file leaves a hole, so no disk blocks are allocated until pages are written.
+            const std::size_t offset = TrajectoryChunkOffset(number);
+            if (ftruncate(fd, static_cast<off_t>(offset + TRAJECTORY_CHUNK_BYTES)) != 0)
+                return false;
+            void *p = mmap(nullptr, TRAJECTORY_CHUNK_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, static_cast<off_t>(offset));
+            if (p == MAP_FAILED)
+                return false;
+
+            chunk = static_cast<char *>(p);
+            chunkNumber = number;
+            index().firstRecord = header->recordCount;
+            index().count = 0;
+            knobChanges()[0] = TrajectoryKnobChange{0, static_cast<float>(knob)};
+            index().knobChanges = 1;
+            return true;
+        }
+
+    public:
+        TrajectoryWriter() = default;
+        TrajectoryWriter(const TrajectoryWriter&) = delete;
+        TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+        ~TrajectoryWriter()
+        {
+            close();
+        }
+
+        bool isOpen() const { return header != nullptr; }
+        std::uint64_t size() const { return header ? header->recordCount : 0; }
+
+        bool open(const char *filename, const char *kind, double initialKnob, double dt)
+        {
+            close();
+            fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+            {
+                printf("ERROR: Cannot open trajectory file for writing: %s\n", filename);
+                return false;
+            }
+
+            void *p = MAP_FAILED;
+            if (ftruncate(fd, TRAJECTORY_HEADER_BYTES) == 0)
+                p = mmap(nullptr, TRAJECTORY_HEADER_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                printf("ERROR: Cannot map trajectory file: %s\n", filename);
+                ::close(fd);
+                fd = -1;
+                return false;
+            }
+
+            header = static_cast<TrajectoryHeader *>(p);
+            memcpy(header->magic, TRAJECTORY_MAGIC, sizeof(header->magic));
+            header->byteOrder = TRAJECTORY_BYTE_ORDER;
+            header->chunkBytes = TRAJECTORY_CHUNK_BYTES;
+            snprintf(header->kind, sizeof(header->kind), "%s", kind);
+            header->knob = knob = initialKnob;
+            header->dt = dt;
+            header->recordCount = 0;
+            return true;
+        }
+
+        // The knob position for the records appended from now on.
+        // If a chunk's knob change table fills up, further changes
+        // take effect at the start of the next chunk.
+        void setKnob(double k)
+        {
+            if (k == knob)
+                return;
+            knob = k;
+
+            // Otherwise the next record starts a new chunk, which begins with the current knob.
+            if (chunk == nullptr || index().count == TRAJECTORY_CHUNK_RECORDS)
+                return;
+
+            const std::uint32_t n = index().knobChanges;
+            TrajectoryKnobChange& last = knobChanges()[n - 1];
+            if (last.record == index().count)
+                last.knob = static_cast<float>(k);      // no records since the last change
+            else if (n < TRAJECTORY_CHUNK_KNOB_CHANGES)
+            {
+                knobChanges()[n] = TrajectoryKnobChange{index().count, static_cast<float>(k)};
+                index().knobChanges = n + 1;
+            }
+        }
+
+        bool append(double x, double y, double z)
+        {
+            if (header == nullptr)
+                return false;
+
+            if (chunk == nullptr || index().count == TRAJECTORY_CHUNK_RECORDS)
+            {
+                if (!mapChunk(chunk ? chunkNumber + 1 : 0))
+                {
+                    printf("ERROR: Cannot extend trajectory file; recording stopped.\n");
+                    close();
+                    return false;
+                }
+            }
+
+            TrajectoryRecord& r = records()[index().count];
+            r.x = static_cast<float>(x);
+            r.y = static_cast<float>(y);
+            r.z = static_cast<float>(z);
+            ++index().count;
+            ++header->recordCount;
+            return true;
+        }
+
+        void close()
+        {
+            if (chunk != nullptr)
+                munmap(chunk, TRAJECTORY_CHUNK_BYTES);
+            if (header != nullptr)
+                munmap(header, TRAJECTORY_HEADER_BYTES);
+            if (fd >= 0)
+                ::close(fd);
+            chunk = nullptr;
+            header = nullptr;
+            fd = -1;
+        }
+    };
+
+
+    class TrajectoryReader
+    {
+    private:
+        int fd = -1;
+        const char *base = nullptr;
+        std::size_t bytes = 0;
+        std::uint64_t count = 0;
+
+        const TrajectoryHeader& header() const { return *reinterpret_cast<const TrajectoryHeader *>(base); }
+
+        const char *chunkAddress(std::uint64_t chunk) const { return base + TrajectoryChunkOffset(chunk); }
+
+    public:
+        TrajectoryReader() = default;
+        TrajectoryReader(const TrajectoryReader&) = delete;
+        TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+        ~TrajectoryReader()
+        {
+            close();
+        }
+
+        // Maps the whole recording. A recording still being written can be
+        // opened; only the records present at the time are visible.
+        bool open(const char *filename)
+        {
+            close();
+            fd = ::open(filename, O_RDONLY);
+            if (fd < 0)
+            {
+                printf("ERROR: Cannot open trajectory file: %s\n", filename);
+                return false;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= TRAJECTORY_HEADER_BYTES)
+            {
+                bytes = static_cast<std::size_t>(st.st_size);
+                void *p = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+                if (p != MAP_FAILED)
+                    base = static_cast<const char *>(p);
+            }
+
+            if (base == nullptr)
+            {
+                printf("ERROR: Cannot map trajectory file: %s\n", filename);
+                close();
+                return false;
+            }
+
+            const TrajectoryHeader& h = header();
+            count = h.recordCount;
+            const std::uint64_t chunks = (count + TRAJECTORY_CHUNK_RECORDS - 1) / TRAJECTORY_CHUNK_RECORDS;
+            if (memcmp(h.magic, TRAJECTORY_MAGIC, sizeof(h.magic)) ||
+                h.byteOrder != TRAJECTORY_BYTE_ORDER ||
+                h.chunkBytes != TRAJECTORY_CHUNK_BYTES ||
+                memchr(h.kind, '\0', sizeof(h.kind)) == nullptr ||
+                TrajectoryChunkOffset(chunks) > bytes)
+            {
+                printf("ERROR: Not a valid trajectory file for this machine: %s\n", filename);
+                close();
+                return false;
+            }
+
+            // Playback jumps around the file, so readahead would mostly be wasted.
+            madvise(const_cast<char *>(base), bytes, MADV_RANDOM);
+            return true;
+        }
+
+        void close()
+        {
+            if (base != nullptr)
+                munmap(const_cast<char *>(base), bytes);
+            if (fd >= 0)
+                ::close(fd);
+            base = nullptr;
+            bytes = 0;
+            count = 0;
+            fd = -1;
+        }
+
+        bool isOpen() const { return base != nullptr; }
+        std::uint64_t size() const { return count; }
+        const char *kind() const { return header().kind; }
+        double dt() const { return header().dt; }
+
+        const TrajectoryRecord& record(std::uint64_t i) const
+        {
+            const char *c = chunkAddress(i / TRAJECTORY_CHUNK_RECORDS);
+            return reinterpret_cast<const TrajectoryRecord *>(c + TRAJECTORY_RECORDS_OFFSET)[i % TRAJECTORY_CHUNK_RECORDS];
+        }
+
+        // The knob position in effect when record `i` was recorded.
+        double knob(std::uint64_t i) const
+        {
+            const char *c = chunkAddress(i / TRAJECTORY_CHUNK_RECORDS);
+            const std::uint32_t n = reinterpret_cast<const TrajectoryIndex *>(c)->knobChanges;
+            const TrajectoryKnobChange *changes = reinterpret_cast<const TrajectoryKnobChange *>(c + sizeof(TrajectoryIndex));
+            const TrajectoryKnobChange *end = changes + std::max<std::uint32_t>(1, std::min<std::size_t>(n, TRAJECTORY_CHUNK_KNOB_CHANGES));
+            const std::uint32_t r = static_cast<std::uint32_t>(i % TRAJECTORY_CHUNK_RECORDS);
+
+            // The last change at or before record r; the first change is at record 0.
+            const TrajectoryKnobChange *after = std::upper_bound(changes + 1, end, r,
+                [](std::uint32_t record, const TrajectoryKnobChange& change) { return record < change.record; });
+            return after[-1].knob;
+        }
+    };
+}
@@ -7,19 +7,29 @@
     https://github.com/cosinekitty/jerkcircuit
 */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include "AudioEngine.hpp"
 #include "MakeChaoticOscillator.hpp"
+#include "SpscRing.hpp"
+#include "StateCache.hpp"
+#include "Trajectory.hpp"
 #include "plotter.hpp"
 
 
-bool IsOutOfBounds(const Analog::ChaoticOscillator& osc)
+bool IsOutOfBounds(double x, double y, double z)
 {
     using namespace std;
 
-    double x = osc.vx();
-    double y = osc.vy();
-    double z = osc.vz();
     if (!isfinite(x) || !isfinite(y) || !isfinite(z))
         return true;
 
@@ -28,18 +38,203 @@ bool IsOutOfBounds(const Analog::ChaoticOscillator& osc)
 }
 
 
+struct SimulationPoint
+{
+    double x;
+    double y;
+    double z;
+};
+
+
+// State shared between the rendering thread and the simulation thread.
+// The controls flow to the simulation through atomics; the results flow
+// back through wait-free rings that the rendering thread drains every frame.
+struct Simulation
+{
+    std::atomic<int> knob{0};
+    std::atomic<int> speed{0};
+    std::atomic<bool> running{true};
+    std::atomic<bool> failure{false};
+    Analog::SpscRing<SimulationPoint> points{1 << 17};
+    Analog::SpscRing<Analog::OscillatorCounters> counters{16};
+};
+
+
+// Runs on its own thread, keeping the oscillator in step with the real-time
+// clock at the current speed and publishing a point every `plotInterval`
+// simulated seconds, until told to stop or the oscillator fails.
+// Normally the oscillator runs one update per audio sample, as the module does,
+// and is checked for failure at every sample. With `dense`, it integrates at its
+// own step size and only the plotted points are computed and checked.
+static void Simulate(Analog::ChaoticOscillator& osc, Analog::TrajectoryWriter& recorder, Simulation& sim, double plotInterval, bool dense)
+{
+    using namespace Analog;
+    using clock = std::chrono::steady_clock;
+
+    const int maxBatch = 256;           // points between checks of the controls
+    const int maxSamples = 1024;        // samples rendered per call to process()
+    double bx[maxSamples], by[maxSamples], bz[maxSamples];
+    int knob = INT_MIN;
+    double owedTime = 0.0;              // simulated time owed to the real-time clock
+    double sincePoint = 0.0;            // simulated time since the last point
+    clock::time_point last = clock::now();
+    clock::time_point lastCounters = last;
+    while (sim.running.load(std::memory_order_relaxed))
+    {
+        const int k = sim.knob.load(std::memory_order_relaxed);
+        if (k != knob)
+        {
+            knob = k;
+            osc.setKnob(knob / 100.0);
+            recorder.setKnob(knob / 100.0);
+        }
+
+        // Simulated seconds per real second.
+        const double rate = std::pow(10.0, 3.0*(sim.speed.load(std::memory_order_relaxed)/100.0));
+        const double dt = rate / SAMPLE_RATE;
+        const clock::time_point now = clock::now();
+        owedTime += rate * std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        // When the simulation cannot keep up, let it fall behind
+        // instead of owing an ever growing backlog.
+        owedTime = std::min(owedTime, rate * 0.1);
+
+        double needed = 0.0;            // simulated time the next step takes
+        for (int n = 0; n < maxBatch; ++n)
+        {
+            double x, y, z;
+            if (dense)
+            {
+                needed = plotInterval;
+                if (owedTime < needed)
+                    break;
+                owedTime -= needed;
+                osc.processDense(&x, &y, &z, 1, plotInterval);
+            }
+            else
+            {
+                // Render the samples up to the next point.
+                const int count = std::clamp(static_cast<int>(std::ceil((plotInterval - sincePoint) / dt)), 1, maxSamples);
+                needed = count * dt;
+                if (owedTime < needed)
+                    break;
+                owedTime -= needed;
+                osc.process(bx, by, bz, count, dt);
+                int s = 0;
+                while (s < count-1 && !IsOutOfBounds(bx[s], by[s], bz[s]))
+                    ++s;
+                x = bx[s];
+                y = by[s];
+                z = bz[s];
+                sincePoint += needed;
+                if (sincePoint < plotInterval && !IsOutOfBounds(x, y, z))
+                    continue;   // a long interval at a low speed: keep rendering
+                sincePoint = std::fmod(sincePoint, plotInterval);
+            }
+
+            recorder.append(x, y, z);   // including the point that fails, if any
+            if (IsOutOfBounds(x, y, z))
+            {
+                sim.failure.store(true);
+                return;
+            }
+
+            // Wait for the renderer rather than dropping points from the trail.
+            while (!sim.points.push(SimulationPoint{x, y, z}))
+            {
+                if (!sim.running.load(std::memory_order_relaxed))
+                    return;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        if constexpr (INSTRUMENTED)
+        {
+            if (now - lastCounters >= std::chrono::microseconds(1000000 / FRAME_RATE))
+            {
+                sim.counters.push(osc.snapshotCounters());
+                osc.resetCounters();
+                lastCounters = now;
+            }
+        }
+
+        // Sleep until the next step is due, but wake often enough to notice the controls.
+        if (owedTime < needed)
+        {
+            const double wait = std::min((needed - owedTime) / rate, 0.002);
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+        }
+    }
+}
+
+
+// raylib's audio callback has no user data pointer, so it finds the engine here.
+static Analog::AudioEngine *TheAudioEngine = nullptr;
+
+static void AudioOutputCallback(void *buffer, unsigned int frames)
+{
+    TheAudioEngine->render(static_cast<float *>(buffer), frames);
+}
+
+
+static int Playback(const char *filename, int trailLength);
+
+
+static int PrintUsage()
+{
+    using namespace Analog;
+
+    printf("USAGE: animate kind [record=file] [trail=n] [audio[=frames]] [dense]\n");
+    printf("       animate play file [trail=n]\n");
+    printf("\n");
+    printf("where kind is one of the following:\n");
+    for (const char *kind : ChaoticOscillatorKinds)
+        printf("    %s\n", kind);
+    printf("\n");
+    printf("record=file saves every plotted point to a trajectory file.\n");
+    printf("trail=n sets the number of points in the trail (default 8000).\n");
+    printf("audio plays x and y as stereo, in audio buffers of the given size (default 128),\n");
+    printf("and shows how much of each buffer's time the audio callback used.\n");
+    printf("dense integrates at the oscillator's own step size and computes only the\n");
+    printf("plotted points, instead of running one update per audio sample.\n");
+    printf("play replays a trajectory file: SPACE pauses, PAGE UP/DOWN scrub,\n");
+    printf("HOME/END jump to the start/end, +/- change the playback rate.\n");
+    return 1;
+}
+
+
 int main(int argc, const char *argv[])
 {
     using namespace Analog;
 
-    if (argc != 2)
+    if (argc < 2)
+        return PrintUsage();
+
+    const bool play = !strcmp(argv[1], "play");
+    const char *recordFileName = nullptr;
+    int trailLength = 8000;
+    int audioFrames = 0;                // 0 = no audio output
+    bool dense = false;                 // dense output instead of one update per sample
+    for (int i = play ? 3 : 2; i < argc; ++i)
     {
-        printf("USAGE: animate kind\n");
-        printf("where kind is one of the following:\n");
-        for (const char *kind : ChaoticOscillatorKinds)
-            printf("    %s\n", kind);
-        return 1;
+        if (!play && !strncmp(argv[i], "record=", 7) && argv[i][7] != '\0')
+            recordFileName = argv[i] + 7;
+        else if (!play && !strcmp(argv[i], "audio"))
+            audioFrames = 128;
+        else if (!play && !strncmp(argv[i], "audio=", 6) && atoi(argv[i] + 6) >= 16)
+            audioFrames = atoi(argv[i] + 6);
+        else if (!play && !strcmp(argv[i], "dense"))
+            dense = true;
+        else if (!strncmp(argv[i], "trail=", 6) && atoi(argv[i] + 6) >= 2)
+            trailLength = atoi(argv[i] + 6);
+        else
+            return PrintUsage();
     }
+
+    if (play)
+        return (argc >= 3) ? Playback(argv[2], trailLength) : PrintUsage();
+
     const char *kind = argv[1];
     auto osc = MakeChaoticOscillator(kind);
     if (!osc)
@@ -47,17 +242,61 @@ int main(int argc, const char *argv[])
         printf("ERROR: Unknown chaotic oscillator kind '%s'\n", kind);
         return 1;
     }
+    if (LoadRangeTable(*osc, kind))
+        printf("Loaded range table for %s\n", kind);
+    if (std::optional<StateCache> cache = LoadStateCache(kind))
+        if (WarmStart(*osc, *cache, std::random_device{}()))
+            printf("Warm start from %s.states\n", kind);
 
-    Plotter plotter(8000);
+    const double plotInterval = 0.01;   // simulated seconds between trail points
+    TrajectoryWriter recorder;
+    if (recordFileName != nullptr)
+    {
+        if (!recorder.open(recordFileName, kind, 0.0, plotInterval))
+            return 1;
+        printf("Recording to %s\n", recordFileName);
+    }
+
+    // The audio runs its own oscillator, in step with the audio clock instead of the trail's.
+    std::unique_ptr<AudioEngine> audio;
+    if (audioFrames > 0)
+    {
+        auto audioOsc = MakeChaoticOscillator(kind);
+        LoadRangeTable(*audioOsc, kind);
+        audio = std::make_unique<AudioEngine>(std::move(audioOsc), SAMPLE_RATE);
+        audio->setGain(0.5);
+        TheAudioEngine = audio.get();
+    }
+
+    Simulation sim;
+    std::thread simThread(Simulate, std::ref(*osc), std::ref(recorder), std::ref(sim), plotInterval, dense);
+
+    Plotter plotter(trailLength);
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Danger Tractor prototype by Don Cross");
     SetTargetFPS(60);
+    AudioStream stream{};
+    if (audio)
+    {
+        InitAudioDevice();
+        SetAudioStreamBufferSizeDefault(audioFrames);
+        stream = LoadAudioStream(SAMPLE_RATE, 32, 2);
+        SetAudioStreamCallback(stream, AudioOutputCallback);
+        PlayAudioStream(stream);
+    }
+    AudioCallbackTiming audioWorst;     // the slowest callback in the last second
+    double audioSeconds = 0.0;          // total callback time in the last second
+    int audioCallbacks = 0;
+    AudioCallbackTiming windowWorst;
+    double windowSeconds = 0.0;
+    int windowCallbacks = 0;
+    int windowFrames = 0;
     const double angleIncrement = 0.005;
     bool autoRotate = false;
     int knob = 0;
     int speed = 0;
     int knobRepeat = 0;
     const int knobThresh = 5;
-    bool failure = false;
+    OscillatorCounters counters;
     while (!WindowShouldClose())
     {
         if (IsKeyDown(KEY_DOWN))
@@ -92,34 +331,149 @@ int main(int argc, const char *argv[])
             --speed;
             knobRepeat = 0;
         }
+        sim.knob.store(knob, std::memory_order_relaxed);
+        sim.speed.store(speed, std::memory_order_relaxed);
+        sim.points.drain([&plotter](const SimulationPoint& p) { plotter.append(p.x, p.y, p.z); });
+        if (audio)
+        {
+            audio->setKnob(knob / 100.0);
+            audio->setSpeed(std::pow(10.0, 3.0*(speed/100.0)));
+            audio->drainTimings([&](const AudioCallbackTiming& t)
+            {
+                windowSeconds += t.seconds;
+                ++windowCallbacks;
+                if (t.seconds > windowWorst.seconds)
+                    windowWorst = t;
+            });
+            if (++windowFrames == FRAME_RATE)
+            {
+                audioWorst = windowWorst;
+                audioSeconds = windowSeconds;
+                audioCallbacks = windowCallbacks;
+                windowWorst = AudioCallbackTiming{};
+                windowSeconds = 0.0;
+                windowCallbacks = windowFrames = 0;
+            }
+        }
+
         BeginDrawing();
         ClearBackground(BLACK);
         plotter.displayKnob(knob);
         plotter.displaySpeed(speed);
-        if (failure)
+        if constexpr (INSTRUMENTED)
         {
+            sim.counters.drain([&counters](const OscillatorCounters& c) { counters = c; });
+            plotter.displayCounters(counters.substepsPerSample(), counters.slopeCallsPerSample(), counters.maxSubsteps, 1.0e6 * counters.blockSeconds);
+        }
+        if (audio && audioCallbacks > 0)
+            plotter.displayAudioLoad(1.0e6 * audioSeconds / audioCallbacks, 1.0e6 * audioWorst.seconds, 1.0e6 * audioWorst.budget);
+        if (sim.failure.load())
             plotter.displayFailureText();
+        plotter.plot();
+        EndDrawing();
+    }
+    if (audio)
+    {
+        StopAudioStream(stream);
+        UnloadAudioStream(stream);
+        CloseAudioDevice();
+        TheAudioEngine = nullptr;
+    }
+    sim.running.store(false);
+    simThread.join();
+    CloseWindow();
+    return 0;
+}
+
+
+static int Playback(const char *filename, int trailLength)
+{
+    using namespace Analog;
+
+    TrajectoryReader recording;
+    if (!recording.open(filename))
+        return 1;
+    const std::uint64_t count = recording.size();
+    printf("Playing %s: %llu points of %s, %lg seconds apart\n",
+        filename, static_cast<unsigned long long>(count), recording.kind(), recording.dt());
+    if (count == 0)
+    {
+        printf("ERROR: The recording is empty.\n");
+        return 1;
+    }
+
+    Plotter plotter(trailLength);
+    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Danger Tractor playback");
+    SetTargetFPS(60);
+    const double angleIncrement = 0.005;
+    bool autoRotate = false;
+    bool playing = true;
+    const double realTimeRate = (static_cast<double>(SAMPLES_PER_FRAME) / SAMPLE_RATE) / recording.dt();
+    double rate = 1.0;                  // playback speed relative to the recording at speed 0
+    double position = 0.0;              // points shown so far, as a fraction to allow slow rates
+    std::uint64_t shown = 0;            // points in the plotter's trail, up to this one
+    while (!WindowShouldClose())
+    {
+        if (IsKeyDown(KEY_DOWN))
+            plotter.rotateX(+angleIncrement);
+        if (IsKeyDown(KEY_UP))
+            plotter.rotateX(-angleIncrement);
+        if (IsKeyDown(KEY_LEFT))
+            plotter.rotateY(+angleIncrement);
+        if (IsKeyDown(KEY_RIGHT))
+            plotter.rotateY(-angleIncrement);
+        if (IsKeyPressed(KEY_R))
+            autoRotate = !autoRotate;
+        if (autoRotate)
+            plotter.rotateX(+angleIncrement);
+        if (IsKeyPressed(KEY_SPACE))
+            playing = !playing;
+        if (IsKeyPressed(KEY_EQUAL) || IsKeyPressed(KEY_KP_ADD))
+            rate = std::min(rate * 2.0, 65536.0);
+        if (IsKeyPressed(KEY_MINUS) || IsKeyPressed(KEY_KP_SUBTRACT))
+            rate = std::max(rate / 2.0, 1.0 / 64.0);
+        if (IsKeyPressed(KEY_HOME))
+            position = 0.0;
+        if (IsKeyPressed(KEY_END))
+            position = count;
+
+        // Scrubbing moves 1% of the recording per frame, however long it is.
+        const double scrub = std::max(1.0, 0.01 * count);
+        if (IsKeyDown(KEY_PAGE_UP))
+            position += scrub;
+        if (IsKeyDown(KEY_PAGE_DOWN))
+            position -= scrub;
+        if (playing)
+            position += rate * realTimeRate;
+        position = std::clamp(position, 1.0, static_cast<double>(count));
+        if (position == count)
+            playing = false;
+
+        // Bring the trail up to date: append when playing forward by less
+        // than a trail length, otherwise rebuild it from the recording.
+        const std::uint64_t target = static_cast<std::uint64_t>(position);
+        std::uint64_t first = shown;
+        const std::uint64_t trailPoints = static_cast<std::uint64_t>(trailLength);
+        if (target < shown || target - shown > trailPoints)
+        {
+            plotter.clear();
+            first = (target > trailPoints) ? target - trailPoints : 0;
         }
-        else
+        for (std::uint64_t i = first; i < target; ++i)
         {
-            plotter.append(osc->vx(), osc->vy(), osc->vz());
-            osc->setKnob(knob / 100.0);
-            double dt = std::pow(10.0, 3.0*(speed/100.0)) / SAMPLE_RATE;
-            double pt = 0.0;
-            for (int s = 0; s < SAMPLES_PER_FRAME; ++s)
-            {
-                osc->update(dt);
-                failure = IsOutOfBounds(*osc);
-                if (failure)
-                    break;
-                pt += dt;
-                if (pt > 0.01)
-                {
-                    pt = 0.0;
-                    plotter.append(osc->vx(), osc->vy(), osc->vz());
-                }
-            }
+            const TrajectoryRecord& r = recording.record(i);
+            if (!IsOutOfBounds(r.x, r.y, r.z))
+                plotter.append(r.x, r.y, r.z);
         }
+        shown = target;
+
+        BeginDrawing();
+        ClearBackground(BLACK);
+        plotter.displayKnob(static_cast<int>(std::round(100.0 * recording.knob(target - 1))));
+        plotter.displayPlayback(target, count, target * recording.dt(), rate, playing);
+        const TrajectoryRecord& last = recording.record(target - 1);
+        if (IsOutOfBounds(last.x, last.y, last.z))
+            plotter.displayFailureText();
         plotter.plot();
         EndDrawing();
     }
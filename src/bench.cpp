@@ -0,0 +1,582 @@
+/*
+    bench.cpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Measures the speed of every oscillator and integrator path,
+    and of JerkCircuit, at several time increments:
+
+        dt = speed / SAMPLE_RATE, for animate's speed factors 1, 31.6 and 1000.
+
+    For each measurement it reports nanoseconds per sample, slope evaluations
+    per sample, samples per second, and, where Linux perf_event_open is permitted,
+    CPU cycles and instructions per sample. A table goes to standard output
+    and the same results go to a JSON file for comparing builds.
+
+    It also times AudioEngine's audio callback at 64 and 128 frames per buffer,
+    with the knob steady and with the knob always moving, and reports how much
+    of each buffer's time the callback uses and how many voices would fit.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "AudioEngine.hpp"
+#include "MakeChaoticOscillator.hpp"
+#include "OscillatorBank.hpp"
+#include "JerkCircuit.hpp"
+#include "NodalCircuit.hpp"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace Analog;
+
+static const double BENCH_SAMPLE_RATE = 44100.0;
+static const std::size_t BLOCK = 512;       // frames rendered per call
+static const std::size_t BANK_VOICES = 64;
+static const double SPEEDS[] = { 1.0, std::pow(10.0, 1.5), 1000.0 };    // animate speed 0, 50, 100
+static const double JERK_DILATIONS[] = { 1.0, 2.0, 3.0 };               // JerkCircuit diverges beyond these
+static const unsigned AUDIO_BUFFER_FRAMES[] = { 64, 128 };
+
+
+class PerfCounters
+{
+private:
+    int cycles = -1;
+    int instructions = -1;
+
+#if defined(__linux__)
+    static int open(std::uint64_t config, int group)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = config;
+        attr.disabled = (group < 0) ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+
+    static std::uint64_t read(int fd)
+    {
+        std::uint64_t count = 0;
+        if (::read(fd, &count, sizeof(count)) != sizeof(count))
+            return 0;
+        return count;
+    }
+#endif
+
+public:
+    PerfCounters()
+    {
+#if defined(__linux__)
+        cycles = open(PERF_COUNT_HW_CPU_CYCLES, -1);
+        if (cycles >= 0)
+            instructions = open(PERF_COUNT_HW_INSTRUCTIONS, cycles);
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        if (instructions >= 0) close(instructions);
+        if (cycles >= 0) close(cycles);
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator= (const PerfCounters&) = delete;
+
+    bool available() const { return cycles >= 0 && instructions >= 0; }
+
+    void start()
+    {
+#if defined(__linux__)
+        if (available())
+        {
+            ioctl(cycles, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(cycles, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    void stop(std::uint64_t& cycleCount, std::uint64_t& instructionCount)
+    {
+        cycleCount = instructionCount = 0;
+#if defined(__linux__)
+        if (available())
+        {
+            ioctl(cycles, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            cycleCount = read(cycles);
+            instructionCount = read(instructions);
+        }
+#endif
+    }
+};
+
+
+// Wraps a model to count how many times the integrators evaluate its slopes.
+// Used in a separate, untimed run, so counting does not disturb the timing.
+template <typename model_t>
+struct CountingModel : model_t
+{
+    static inline long count = 0;
+
+    template <typename real_t>
+    static void slopes(real_t& mx, real_t& my, real_t& mz, const real_t& x, const real_t& y, const real_t& z, const real_t& c)
+    {
+        ++count;
+        model_t::slopes(mx, my, mz, x, y, z, c);
+    }
+};
+
+
+struct BenchResult
+{
+    std::string kind;
+    std::string path;
+    double speed = 1;
+    double dt = 0;
+    double samples = 0;
+    double seconds = 0;
+    double evalsPerSample = 0;
+    bool finite = true;
+    bool perf = false;
+    std::uint64_t cycles = 0;
+    std::uint64_t instructions = 0;
+
+    double nsPerSample() const { return 1.0e+9 * seconds / samples; }
+    double samplesPerSecond() const { return samples / seconds; }
+};
+
+
+struct AudioHeadroom
+{
+    std::string kind;
+    unsigned frames = 0;
+    bool moving = false;        // knob changing every callback
+    double budget = 0;          // seconds of audio per callback
+    double mean = 0;            // callback seconds
+    double p99 = 0;
+    double worst = 0;
+
+    // Voices that fit in one callback, sized by the 99th percentile time.
+    int voices() const { return (p99 > 0) ? static_cast<int>(budget / p99) : 0; }
+};
+
+
+struct BenchContext
+{
+    double minSeconds = 0.2;
+    PerfCounters perf;
+    std::vector<BenchResult> results;
+    std::vector<AudioHeadroom> audio;
+};
+
+
+// Call block() repeatedly until at least minSeconds have passed,
+// or until a block reports a non-finite output: a diverged state is not worth timing,
+// and in adaptive mode every step on it runs the step size controller to its limit.
+// Each call must produce `samplesPerBlock` samples and return whether they are all finite.
+template <typename block_t>
+static BenchResult Measure(BenchContext& context, double samplesPerBlock, block_t block)
+{
+    BenchResult r;
+    long blocks = 0;
+    context.perf.start();
+    auto start = std::chrono::steady_clock::now();
+    double elapsed;
+    do
+    {
+        r.finite = block() && r.finite;
+        ++blocks;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    while (elapsed < context.minSeconds && r.finite);
+    context.perf.stop(r.cycles, r.instructions);
+    r.perf = context.perf.available();
+    r.seconds = elapsed;
+    r.samples = blocks * samplesPerBlock;
+    return r;
+}
+
+
+static void Report(BenchContext& context, BenchResult r, const char *kind, const std::string& path, double speed, double dt, double evalsPerSample)
+{
+    r.kind = kind;
+    r.path = path;
+    r.speed = speed;
+    r.dt = dt;
+    r.evalsPerSample = evalsPerSample;
+
+    printf("%-6s %-18s %7.1f %12.1f %10.1f %14.0f", kind, path.c_str(), speed, r.nsPerSample(), evalsPerSample, r.samplesPerSecond());
+    if (r.perf)
+        printf(" %10.1f %10.1f", r.cycles / r.samples, r.instructions / r.samples);
+    else
+        printf(" %10s %10s", "-", "-");
+    printf("%s\n", r.finite ? "" : "  (diverged)");
+    fflush(stdout);
+    context.results.push_back(r);
+}
+
+
+static bool IsFinite(const float *buffer, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i)
+        if (!std::isfinite(buffer[i]))
+            return false;
+    return true;
+}
+
+
+template <typename model_t, typename integrator_t>
+static void BenchStatic(BenchContext& context, const char *kind, const char *name, double speed, double tolerance = 0.0, bool dense = false)
+{
+    const double dt = speed / BENCH_SAMPLE_RATE;
+    float x[BLOCK], y[BLOCK], z[BLOCK];
+
+    // Count slope evaluations in a short untimed run.
+    const int countBlocks = 16;
+    BasicOscillator<CountingModel<model_t>, integrator_t> counted;
+    counted.setTolerance(tolerance);
+    CountingModel<model_t>::count = 0;
+    int b = 0;
+    while (b < countBlocks)
+    {
+        if (dense)
+            counted.processDense(x, y, z, BLOCK, dt);
+        else
+            counted.process(x, y, z, BLOCK, dt);
+        ++b;
+        if (!IsFinite(x, BLOCK))
+            break;
+    }
+    const double evals = static_cast<double>(CountingModel<model_t>::count) / (b * BLOCK);
+
+    BasicOscillator<model_t, integrator_t> osc;
+    osc.setTolerance(tolerance);
+    BenchResult r = Measure(context, BLOCK, [&]()
+    {
+        if (dense)
+            osc.processDense(x, y, z, BLOCK, dt);
+        else
+            osc.process(x, y, z, BLOCK, dt);
+        return IsFinite(x, BLOCK);
+    });
+    Report(context, r, kind, name, speed, dt, evals);
+}
+
+
+template <typename model_t>
+static void BenchModel(BenchContext& context, const char *kind)
+{
+    for (double speed : SPEEDS)
+    {
+        const double dt = speed / BENCH_SAMPLE_RATE;
+        float x[BLOCK], y[BLOCK], z[BLOCK];
+
+        // The virtual ChaoticOscillator integrates exactly like BasicOscillator<model_t>,
+        // so it has the same number of slope evaluations.
+        const int countBlocks = 16;
+        BasicOscillator<CountingModel<model_t>> counted;
+        CountingModel<model_t>::count = 0;
+        for (int b = 0; b < countBlocks; ++b)
+            counted.process(x, y, z, BLOCK, dt);
+        const double midpointEvals = static_cast<double>(CountingModel<model_t>::count) / (countBlocks * BLOCK);
+
+        auto osc = MakeChaoticOscillator(kind);
+        BenchResult r = Measure(context, BLOCK, [&]()
+        {
+            osc->process(x, y, z, BLOCK, dt);
+            return IsFinite(x, BLOCK);
+        });
+        Report(context, r, kind, "virtual-midpoint", speed, dt, midpointEvals);
+
+        BenchStatic<model_t, MidpointIntegrator >(context, kind, "static-midpoint",  speed);
+        BenchStatic<model_t, HeunIntegrator     >(context, kind, "static-heun",      speed);
+        BenchStatic<model_t, RalstonIntegrator  >(context, kind, "static-ralston",   speed);
+        BenchStatic<model_t, Rk4Integrator      >(context, kind, "static-rk4",       speed);
+        BenchStatic<model_t, TrapezoidIntegrator>(context, kind, "static-trapezoid", speed);
+        BenchStatic<model_t, MidpointIntegrator >(context, kind, "adaptive-1e-6",    speed, 1.0e-6);
+        BenchStatic<model_t, MidpointIntegrator >(context, kind, "dense-midpoint",   speed, 0.0, true);
+
+        // Oscillator bank: report the cost per voice per sample.
+        std::vector<float> bx(BLOCK * BANK_VOICES), by(BLOCK * BANK_VOICES), bz(BLOCK * BANK_VOICES);
+        OscillatorBank<CountingModel<model_t>> countedBank(BANK_VOICES);
+        CountingModel<model_t>::count = 0;
+        countedBank.process(bx.data(), by.data(), bz.data(), BLOCK, dt);
+        const double bankEvals = static_cast<double>(CountingModel<model_t>::count) * BANK_LANES / (BLOCK * BANK_VOICES);
+
+        OscillatorBank<model_t> bank(BANK_VOICES);
+        r = Measure(context, BLOCK * BANK_VOICES, [&]()
+        {
+            bank.process(bx.data(), by.data(), bz.data(), BLOCK, dt);
+            return IsFinite(bx.data(), bx.size());
+        });
+        Report(context, r, kind, "bank-midpoint", speed, dt, bankEvals);
+    }
+}
+
+
+static void BenchAudio(BenchContext& context, const char *kind)
+{
+    for (unsigned frames : AUDIO_BUFFER_FRAMES)
+    {
+        for (bool moving : {false, true})
+        {
+            AudioEngine engine(MakeChaoticOscillator(kind), BENCH_SAMPLE_RATE);
+            std::vector<float> buffer(2 * frames);
+            std::vector<double> seconds;
+            seconds.reserve(1 << 16);
+            auto start = std::chrono::steady_clock::now();
+            do
+            {
+                if (moving)
+                    engine.setKnob((seconds.size() & 1) ? -0.5 : +0.5);
+                engine.render(buffer.data(), frames);
+                engine.drainTimings([&seconds](const AudioCallbackTiming& t) { seconds.push_back(t.seconds); });
+            }
+            while (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < context.minSeconds);
+
+            if (seconds.empty())
+            {
+                printf("%-6s %7u %-7s  (no callback timings received)\n", kind, frames, moving ? "moving" : "steady");
+                fflush(stdout);
+                continue;
+            }
+
+            std::sort(seconds.begin(), seconds.end());
+            AudioHeadroom h;
+            h.kind = kind;
+            h.frames = frames;
+            h.moving = moving;
+            h.budget = frames / BENCH_SAMPLE_RATE;
+            for (double s : seconds)
+                h.mean += s;
+            h.mean /= seconds.size();
+            h.p99 = seconds[seconds.size() * 99 / 100];
+            h.worst = seconds.back();
+            context.audio.push_back(h);
+
+            printf("%-6s %7u %-7s %10.1f %10.2f %10.2f %10.2f %7.2f%% %8d\n",
+                kind, frames, moving ? "moving" : "steady", 1.0e6 * h.budget,
+                1.0e6 * h.mean, 1.0e6 * h.p99, 1.0e6 * h.worst,
+                100.0 * h.p99 / h.budget, h.voices());
+            fflush(stdout);
+        }
+    }
+}
+
+
+template <typename circuit_t>
+static void BenchJerk(BenchContext& context, const char *path, JerkSolver solver)
+{
+    for (double dilation : JERK_DILATIONS)
+    {
+        circuit_t circuit(dilation, 0.0, 0.1, 0.0);
+        circuit.setSolver(solver);
+        const float rate = static_cast<float>(BENCH_SAMPLE_RATE);
+        BenchResult r = Measure(context, BLOCK, [&]()
+        {
+            for (std::size_t i = 0; i < BLOCK; ++i)
+                circuit.update(rate);
+            return std::isfinite(circuit.xVoltage());
+        });
+        // Each solver iteration evaluates the diode once.
+        Report(context, r, "jerk", path, dilation, dilation / BENCH_SAMPLE_RATE, circuit.stats().meanIterations());
+    }
+}
+
+
+static void BenchNodal(BenchContext& context, const char *filename)
+{
+    std::ifstream infile(filename);
+    if (!infile)
+    {
+        printf("(skipping nodal: cannot open %s)\n", filename);
+        return;
+    }
+    std::stringstream text;
+    text << infile.rdbuf();
+    std::string error;
+    std::optional<NodalCircuit> parsed = ParseNetlist(text.str().c_str(), error);
+    if (!parsed)
+    {
+        printf("(skipping nodal: %s: %s)\n", filename, error.c_str());
+        return;
+    }
+
+    const int x = parsed->findNode("7");
+    for (double dilation : JERK_DILATIONS)
+    {
+        NodalCircuit circuit = *parsed;
+        const double dt = dilation / BENCH_SAMPLE_RATE;
+        long iterations = 0;
+        BenchResult r = Measure(context, BLOCK, [&]()
+        {
+            for (std::size_t i = 0; i < BLOCK; ++i)
+                iterations += circuit.update(dt);
+            return std::isfinite(circuit.voltage(x));
+        });
+        Report(context, r, "jerk", "nodal-newton", dilation, dt, iterations / r.samples);
+    }
+}
+
+
+static void PrintJsonString(FILE *outfile, const std::string& s)
+{
+    fputc('"', outfile);
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            fputc('\\', outfile);
+        fputc(c, outfile);
+    }
+    fputc('"', outfile);
+}
+
+
+static bool WriteJson(const char *filename, const BenchContext& context)
+{
+    FILE *outfile = fopen(filename, "wt");
+    if (outfile == nullptr)
+    {
+        printf("ERROR: Cannot open output file: %s\n", filename);
+        return false;
+    }
+
+    fprintf(outfile, "{\n");
+    fprintf(outfile, "  \"compiler\": ");
+    PrintJsonString(outfile, __VERSION__);
+    fprintf(outfile, ",\n");
+    fprintf(outfile, "  \"bankLanes\": %d,\n", static_cast<int>(BANK_LANES));
+    fprintf(outfile, "  \"sampleRate\": %g,\n", BENCH_SAMPLE_RATE);
+    fprintf(outfile, "  \"perfCounters\": %s,\n", context.perf.available() ? "true" : "false");
+    fprintf(outfile, "  \"results\": [\n");
+    for (std::size_t i = 0; i < context.results.size(); ++i)
+    {
+        const BenchResult& r = context.results[i];
+        fprintf(outfile, "    {\"kind\": ");
+        PrintJsonString(outfile, r.kind);
+        fprintf(outfile, ", \"path\": ");
+        PrintJsonString(outfile, r.path);
+        fprintf(outfile, ", \"speed\": %0.6g, \"dt\": %0.6g, \"samples\": %0.0f, \"nsPerSample\": %0.3f, \"evalsPerSample\": %0.3f, \"samplesPerSec\": %0.0f",
+            r.speed, r.dt, r.samples, r.nsPerSample(), r.evalsPerSample, r.samplesPerSecond());
+        if (r.perf)
+            fprintf(outfile, ", \"cyclesPerSample\": %0.2f, \"instructionsPerSample\": %0.2f", r.cycles / r.samples, r.instructions / r.samples);
+        else
+            fprintf(outfile, ", \"cyclesPerSample\": null, \"instructionsPerSample\": null");
+        fprintf(outfile, ", \"finite\": %s}%s\n", r.finite ? "true" : "false", (i+1 < context.results.size()) ? "," : "");
+    }
+    fprintf(outfile, "  ],\n");
+    fprintf(outfile, "  \"audioCallbacks\": [\n");
+    for (std::size_t i = 0; i < context.audio.size(); ++i)
+    {
+        const AudioHeadroom& h = context.audio[i];
+        fprintf(outfile, "    {\"kind\": ");
+        PrintJsonString(outfile, h.kind);
+        fprintf(outfile, ", \"frames\": %u, \"knob\": \"%s\", \"budgetMicros\": %0.3f, \"meanMicros\": %0.3f, \"p99Micros\": %0.3f, \"worstMicros\": %0.3f, \"voices\": %d}%s\n",
+            h.frames, h.moving ? "moving" : "steady", 1.0e6 * h.budget, 1.0e6 * h.mean, 1.0e6 * h.p99, 1.0e6 * h.worst,
+            h.voices(), (i+1 < context.audio.size()) ? "," : "");
+    }
+    fprintf(outfile, "  ]\n");
+    fprintf(outfile, "}\n");
+
+    const bool ok = !ferror(outfile);
+    if (fclose(outfile) != 0 || !ok)
+    {
+        printf("ERROR: Failed writing output file: %s\n", filename);
+        return false;
+    }
+    return true;
+}
+
+
+static bool BenchKind(BenchContext& context, const char *kind)
+{
+    if (!strcmp(kind, "aiza"))
+        BenchModel<AizawaModel>(context, kind);
+    else if (!strcmp(kind, "boul"))
+        BenchModel<BoualiModel>(context, kind);
+    else if (!strcmp(kind, "ruck"))
+        BenchModel<RucklidgeModel>(context, kind);
+    else if (!strcmp(kind, "sprot"))
+        BenchModel<SprottModel>(context, kind);
+    else if (!strcmp(kind, "jerk"))
+    {
+        BenchJerk<JerkCircuit>(context, "fixed-point", JerkSolver::FixedPoint);
+        BenchJerk<JerkCircuit>(context, "newton", JerkSolver::Newton);
+        BenchJerk<FastJerkCircuit>(context, "fast-newton", JerkSolver::Newton);
+        BenchNodal(context, "jerk.cir");
+    }
+    else
+        return false;
+    return true;
+}
+
+
+int main(int argc, const char *argv[])
+{
+    const char *kind = "all";
+    const char *jsonFileName = "bench.json";
+    BenchContext context;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strncmp(argv[i], "json=", 5))
+            jsonFileName = argv[i] + 5;
+        else if (!strncmp(argv[i], "time=", 5) && atof(argv[i] + 5) > 0.0)
+            context.minSeconds = atof(argv[i] + 5);
+        else if (i == 1)
+            kind = argv[i];
+        else
+        {
+            printf("USAGE: bench [kind | jerk | all] [time=seconds] [json=filename]\n");
+            printf("\nwhere kind is one of:\n");
+            for (const char *k : ChaoticOscillatorKinds)
+                printf("    %s\n", k);
+            printf("\ntime is the minimum measuring time per result (default 0.2).\n");
+            printf("json is the output file name (default bench.json).\n");
+            return 1;
+        }
+    }
+
+    if (!context.perf.available())
+        printf("(perf_event_open is not available: cycles and instructions are not reported)\n");
+
+    printf("%-6s %-18s %7s %12s %10s %14s %10s %10s\n", "kind", "path", "speed", "ns/sample", "evals", "samples/sec", "cycles", "instr");
+    if (!strcmp(kind, "all"))
+    {
+        for (const char *k : ChaoticOscillatorKinds)
+            BenchKind(context, k);
+        BenchKind(context, "jerk");
+    }
+    else if (!BenchKind(context, kind))
+    {
+        printf("ERROR: Unknown kind '%s'\n", kind);
+        return 1;
+    }
+
+    printf("\n%-6s %7s %-7s %10s %10s %10s %10s %8s %8s\n", "kind", "frames", "knob", "budget_us", "mean_us", "p99_us", "max_us", "load", "voices");
+    for (const char *k : ChaoticOscillatorKinds)
+        if (!strcmp(kind, "all") || !strcmp(kind, k))
+            BenchAudio(context, k);
+
+    if (!WriteJson(jsonFileName, context))
+        return 1;
+
+    printf("Wrote: %s\n", jsonFileName);
+    return 0;
+}
@@ -0,0 +1,276 @@
+/*
+    calibrate.cpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Measures the output ranges of chaotic oscillators across a grid of
+    knob positions, using all CPU cores, and writes one range table per
+    oscillator kind (see RangeTable.hpp). Oscillators that load the table
+    remap their outputs using ranges interpolated at the current knob position,
+    so the outputs stay within [-AMPLITUDE, +AMPLITUDE] as the knob moves.
+
+    Along the way it samples states on the attractor at each knob position
+    and writes them to a state cache per kind (see StateCache.hpp).
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "MakeChaoticOscillator.hpp"
+#include "Parallel.hpp"
+#include "StateCache.hpp"
+
+struct CalibrateOptions
+{
+    double sampleRate = 44100;
+    double settleSeconds = 60;
+    double recordSeconds = 3600;
+    double margin = 0.05;
+    int knobs = 21;
+    int states = 32;
+    unsigned threads = Analog::DefaultThreadCount();
+};
+
+struct Measurement
+{
+    Analog::RangeRow range;
+    std::vector<Analog::OscillatorState> states;
+    bool diverged = false;
+};
+
+const double DIVERGENCE_RADIUS = 1.0e+6;
+
+static int PrintUsage();
+static bool ParseArg(const char *arg, CalibrateOptions& options);
+static void Measure(const char *kind, const CalibrateOptions& options, Measurement& m);
+
+int main(int argc, const char *argv[])
+{
+    using namespace Analog;
+
+    if (argc < 2)
+        return PrintUsage();
+
+    std::vector<const char *> kinds;
+    if (!strcmp(argv[1], "all"))
+    {
+        kinds = ChaoticOscillatorKinds;
+    }
+    else
+    {
+        if (MakeChaoticOscillator(argv[1]) == nullptr)
+        {
+            printf("ERROR: Unknown chaotic oscillator kind '%s'\n", argv[1]);
+            return 1;
+        }
+        kinds.push_back(argv[1]);
+    }
+
+    CalibrateOptions options;
+    for (int i = 2; i < argc; ++i)
+        if (!ParseArg(argv[i], options))
+            return 1;
+
+    // One job per (kind, knob) pair, knob varying fastest.
+    const std::size_t knobs = static_cast<std::size_t>(options.knobs);
+    const std::size_t count = kinds.size() * knobs;
+    std::vector<Measurement> results(count);
+    for (std::size_t index = 0; index < count; ++index)
+        results[index].range.knob = (knobs > 1) ? -1.0 + 2.0*(index % knobs)/(knobs - 1) : 0.0;
+
+    printf("Calibrating %zu kind(s) at %d knob positions on %u threads...\n", kinds.size(), options.knobs, options.threads);
+    auto start = std::chrono::steady_clock::now();
+    ParallelFor(count, options.threads, [&](std::size_t index, unsigned)
+    {
+        Measure(kinds[index / knobs], options, results[index]);
+    });
+    auto finish = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(finish - start).count();
+    printf("Finished in %0.3lf seconds.\n", elapsed);
+
+    int rc = 0;
+    for (std::size_t k = 0; k < kinds.size(); ++k)
+    {
+        RangeTable table;
+        bool ok = true;
+        for (std::size_t j = 0; ok && j < knobs; ++j)
+        {
+            const Measurement& m = results[k*knobs + j];
+            if (m.diverged)
+            {
+                printf("ERROR: %s diverged at knob %0.6lf\n", kinds[k], m.range.knob);
+                ok = false;
+            }
+            else if (!table.append(m.range))
+            {
+                printf("ERROR: %s has an empty range at knob %0.6lf\n", kinds[k], m.range.knob);
+                ok = false;
+            }
+        }
+
+        // Keep any maximum time step already found by stepsearch.
+        char filename[100];
+        RangeTableFileName(kinds[k], filename, sizeof(filename));
+        if (ok)
+        {
+            std::optional<RangeTable> previous = LoadRangeTable(filename, kinds[k]);
+            if (previous)
+                table.maxStep = previous->maxStep;
+        }
+        char comment[200];
+        snprintf(comment, sizeof(comment), "calibrate: rate=%lg settle=%lg record=%lg margin=%lg",
+            options.sampleRate, options.settleSeconds, options.recordSeconds, options.margin);
+        if (ok && SaveRangeTable(filename, kinds[k], table, comment))
+            printf("Wrote %s\n", filename);
+        else
+            rc = 1;
+
+        if (ok && options.states > 0)
+        {
+            StateCache cache;
+            for (std::size_t j = 0; j < knobs; ++j)
+            {
+                const Measurement& m = results[k*knobs + j];
+                cache.addGroup(m.range.knob);
+                for (const OscillatorState& s : m.states)
+                    cache.add(s.x, s.y, s.z);
+            }
+            StateCacheFileName(kinds[k], filename, sizeof(filename));
+            if (SaveStateCache(filename, kinds[k], cache, comment))
+                printf("Wrote %s\n", filename);
+            else
+                rc = 1;
+        }
+    }
+    return rc;
+}
+
+
+static int PrintUsage()
+{
+    printf(
+        "USAGE: calibrate kind [options...]\n"
+        "\n"
+        "Measures output ranges at evenly spaced knob positions in [-1, +1]\n"
+        "and writes them to the range table file kind.range.\n"
+        "Also writes states sampled on the attractor to kind.states.\n"
+        "The kind may be 'all' to calibrate every kind of oscillator:\n"
+    );
+    for (const char *kind : Analog::ChaoticOscillatorKinds)
+        printf("    %s\n", kind);
+    printf(
+        "\n"
+        "Options:\n"
+        "    knobs=n     number of knob positions (default 21)\n"
+        "    rate=hz     sample rate (default 44100)\n"
+        "    settle=s    seconds to run before measuring (default 60)\n"
+        "    record=s    seconds to measure (default 3600)\n"
+        "    margin=f    widen each range by this fraction on both ends (default 0.05)\n"
+        "    states=n    states to cache per knob position (default 32; 0 = none)\n"
+        "    threads=n   worker threads (default: all cores)\n"
+        "\n"
+    );
+    return 1;
+}
+
+
+static bool ParseArg(const char *arg, CalibrateOptions& options)
+{
+    const char *eq = strchr(arg, '=');
+    if (eq == nullptr)
+    {
+        printf("ERROR: Invalid argument: %s\n", arg);
+        return false;
+    }
+
+    const std::string name(arg, eq - arg);
+    char *end = nullptr;
+    const double x = strtod(eq + 1, &end);
+    if (end == eq + 1 || *end != '\0' || !std::isfinite(x))
+    {
+        printf("ERROR: Invalid number in argument: %s\n", arg);
+        return false;
+    }
+
+    if (name == "knobs" && x >= 1 && x <= 1000)
+        options.knobs = static_cast<int>(x);
+    else if (name == "rate" && x > 0)
+        options.sampleRate = x;
+    else if (name == "settle" && x >= 0)
+        options.settleSeconds = x;
+    else if (name == "record" && x > 0)
+        options.recordSeconds = x;
+    else if (name == "margin" && x >= 0)
+        options.margin = x;
+    else if (name == "states" && x >= 0 && x <= 100000)
+        options.states = static_cast<int>(x);
+    else if (name == "threads" && x >= 1)
+        options.threads = static_cast<unsigned>(x);
+    else
+    {
+        printf("ERROR: Invalid argument: %s\n", arg);
+        return false;
+    }
+    return true;
+}
+
+
+static void Measure(const char *kind, const CalibrateOptions& options, Measurement& m)
+{
+    using namespace Analog;
+
+    // The oscillator starts with its fixed ranges; only the raw values matter here.
+    std::unique_ptr<ChaoticOscillator> osc = MakeChaoticOscillator(kind);
+    osc->setKnob(m.range.knob);
+
+    const double dt = 1.0 / options.sampleRate;
+    const long settle = static_cast<long>(options.settleSeconds * options.sampleRate);
+    const long record = std::max(1L, static_cast<long>(options.recordSeconds * options.sampleRate));
+
+    // Cache a state at the end of each of `states` equal slices of the recording.
+    const long slice = (options.states > 0) ? std::max(1L, record / options.states) : 0;
+
+    RangeRow& r = m.range;
+    for (long i = 0; i < settle + record; ++i)
+    {
+        osc->update(dt);
+        const double x = osc->rx();
+        const double y = osc->ry();
+        const double z = osc->rz();
+        if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z) || std::sqrt(x*x + y*y + z*z) > DIVERGENCE_RADIUS)
+        {
+            m.diverged = true;
+            return;
+        }
+        if (i == settle)
+        {
+            r.xmin = r.xmax = x;
+            r.ymin = r.ymax = y;
+            r.zmin = r.zmax = z;
+        }
+        else if (i > settle)
+        {
+            r.xmin = std::min(r.xmin, x);
+            r.xmax = std::max(r.xmax, x);
+            r.ymin = std::min(r.ymin, y);
+            r.ymax = std::max(r.ymax, y);
+            r.zmin = std::min(r.zmin, z);
+            r.zmax = std::max(r.zmax, z);
+        }
+        if (slice > 0 && i >= settle && (i - settle + 1) % slice == 0 && m.states.size() < static_cast<std::size_t>(options.states))
+            m.states.push_back(osc->saveState());
+    }
+
+    const double mx = options.margin * (r.xmax - r.xmin);
+    const double my = options.margin * (r.ymax - r.ymin);
+    const double mz = options.margin * (r.zmax - r.zmin);
+    r.xmin -= mx;
+    r.xmax += mx;
+    r.ymin -= my;
+    r.ymax += my;
+    r.zmin -= mz;
+    r.zmax += mz;
+}
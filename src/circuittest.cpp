@@ -0,0 +1,123 @@
+/*
+    circuittest.cpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Simulates a netlist with the NodalCircuit engine and checks it against
+    the hand-coded JerkCircuit class: how closely the voltages agree,
+    and what each costs per sample.
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "JerkCircuit.hpp"
+#include "NodalCircuit.hpp"
+
+static const double SAMPLE_RATE = 44100.0;
+
+template <typename circuit_t, typename update_t>
+static double NanosecondsPerSample(circuit_t& circuit, update_t update, long samples)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < samples; ++i)
+        update(circuit);
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / samples;
+}
+
+int main(int argc, const char *argv[])
+{
+    using namespace Analog;
+
+    if (argc > 2)
+    {
+        printf("USAGE: circuittest [netlist]\n");
+        printf("\nThe netlist defaults to jerk.cir. Its nodes 1, 7, 8, 14 are compared\n");
+        printf("with the w, x, y, z voltages of the hand-coded JerkCircuit.\n");
+        return 1;
+    }
+
+    const char *filename = (argc == 2) ? argv[1] : "jerk.cir";
+    std::ifstream infile(filename);
+    if (!infile)
+    {
+        printf("ERROR: Cannot open netlist file: %s\n", filename);
+        return 1;
+    }
+    std::stringstream text;
+    text << infile.rdbuf();
+
+    std::string error;
+    std::optional<NodalCircuit> parsed = ParseNetlist(text.str().c_str(), error);
+    if (!parsed)
+    {
+        printf("ERROR: %s: %s\n", filename, error.c_str());
+        return 1;
+    }
+    NodalCircuit& engine = *parsed;
+    printf("%s: %d nodes, %d capacitors, %d diodes, %d op-amps\n", filename,
+        (int)engine.nodeCount(), (int)engine.capacitorCount(), (int)engine.diodeCount(), (int)engine.opampCount());
+
+    const int w = engine.findNode("1");
+    const int x = engine.findNode("7");
+    const int y = engine.findNode("8");
+    const int z = engine.findNode("14");
+    if (w < 0 || x < 0 || y < 0 || z < 0)
+    {
+        printf("ERROR: The netlist must have nodes 1, 7, 8, 14 to compare with JerkCircuit.\n");
+        return 1;
+    }
+
+    JerkCircuit hand(1.0, engine.voltage(w), engine.voltage(x), engine.voltage(y));
+    hand.setSolver(JerkSolver::Newton);
+
+    // Both solve the same implicit midpoint equations, so they agree to rounding error,
+    // but chaos amplifies any difference. Report the agreement over the first 10 ms,
+    // and how long the trajectories stay within a microvolt.
+    const double dt = 1.0 / SAMPLE_RATE;
+    const long compareSamples = static_cast<long>(SAMPLE_RATE);
+    const long earlySamples = compareSamples / 100;
+    double earlyDiff = 0.0;
+    long agreeSamples = -1;
+    long engineIterations = 0;
+    for (long i = 0; i < compareSamples; ++i)
+    {
+        hand.update(SAMPLE_RATE);
+        engineIterations += engine.update(dt);
+        double diff = std::abs(hand.wVoltage() - engine.voltage(w));
+        diff = std::max(diff, std::abs(hand.xVoltage() - engine.voltage(x)));
+        diff = std::max(diff, std::abs(hand.yVoltage() - engine.voltage(y)));
+        diff = std::max(diff, std::abs(hand.zVoltage() - engine.voltage(z)));
+        if (i < earlySamples)
+            earlyDiff = std::max(earlyDiff, diff);
+        if (agreeSamples < 0 && diff > 1.0e-6)
+            agreeSamples = i;
+    }
+    if (agreeSamples < 0)
+        agreeSamples = compareSamples;
+
+    printf("Max voltage difference over the first %ld samples: %g V\n", earlySamples, earlyDiff);
+    printf("Voltages agree within 1 uV for %0.3f seconds.\n", agreeSamples / SAMPLE_RATE);
+    printf("Newton iterations per sample: engine %0.2f, JerkCircuit %0.2f\n",
+        static_cast<double>(engineIterations) / compareSamples, hand.stats().meanIterations());
+
+    const long benchSamples = 30 * compareSamples;
+    JerkCircuit fixedPoint(1.0, 0.0, 0.1, 0.0);
+    JerkCircuit newton(1.0, 0.0, 0.1, 0.0);
+    newton.setSolver(JerkSolver::Newton);
+    FastJerkCircuit fastNewton(1.0, 0.0, 0.1, 0.0);
+    fastNewton.setSolver(JerkSolver::Newton);
+    engine.initialize();
+
+    printf("\nCost per sample at %g Hz:\n", SAMPLE_RATE);
+    printf("    JerkCircuit, fixed point   %6.1f ns\n", NanosecondsPerSample(fixedPoint, [](JerkCircuit& c){ c.update(SAMPLE_RATE); }, benchSamples));
+    printf("    JerkCircuit, Newton        %6.1f ns\n", NanosecondsPerSample(newton, [](JerkCircuit& c){ c.update(SAMPLE_RATE); }, benchSamples));
+    printf("    FastJerkCircuit, Newton    %6.1f ns\n", NanosecondsPerSample(fastNewton, [](FastJerkCircuit& c){ c.update(SAMPLE_RATE); }, benchSamples));
+    printf("    NodalCircuit               %6.1f ns\n", NanosecondsPerSample(engine, [dt](NodalCircuit& c){ c.update(dt); }, benchSamples));
+
+    // Keep the results observable so the loops cannot be optimized away.
+    const double sum = fixedPoint.xVoltage() + newton.xVoltage() + fastNewton.xVoltage() + engine.voltage(x);
+    return std::isfinite(sum) ? 0 : 1;
+}
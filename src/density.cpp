@@ -0,0 +1,357 @@
+/*
+    density.cpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Renders the long-run density of a chaotic oscillator's attractor as a PNG
+    image: how often the trajectory passes through each pixel, projected the
+    same way animate projects its trail (see Projection.hpp).
+
+    Many trajectories run in parallel, one job each, and every thread counts
+    its hits in its own histogram, so the threads never share a cache line.
+    The histograms are stored in 64x64-bin tiles, so a trajectory that moves a
+    few pixels per point keeps hitting the same few kilobytes of memory.
+    At the end the histograms are summed, tone-mapped on a log scale, and saved.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+#include "MakeChaoticOscillator.hpp"
+#include "Parallel.hpp"
+#include "Png.hpp"
+#include "Projection.hpp"
+#include "StateCache.hpp"
+
+struct DensityOptions
+{
+    int width = 1024;
+    int height = 1024;
+    double points = 1.0e9;
+    double knob = 0.0;
+    double rotateX = 0.0;       // degrees, applied like animate's arrow keys
+    double rotateY = 0.0;
+    double interval = 0.0;      // simulated seconds between points; 0 = a quarter of max_dt
+    double settleSeconds = 60;
+    int trajectories = 0;       // 0 = four per thread
+    unsigned threads = Analog::DefaultThreadCount();
+    std::string out;
+};
+
+
+class TiledHistogram
+{
+private:
+    static const int TILE_SHIFT = 6;
+    static const int TILE = 1 << TILE_SHIFT;
+    static const int TILE_MASK = TILE - 1;
+
+    int tilesX;
+    std::vector<std::uint32_t> bins;
+
+public:
+    const int width;
+    const int height;
+
+    TiledHistogram(int w, int h)
+        : tilesX((w + TILE_MASK) >> TILE_SHIFT)
+        , bins(static_cast<std::size_t>(tilesX) * ((h + TILE_MASK) >> TILE_SHIFT) * TILE * TILE)
+        , width(w)
+        , height(h)
+        {}
+
+    static std::size_t index(int tilesX, int x, int y)
+    {
+        const std::size_t tile = static_cast<std::size_t>(y >> TILE_SHIFT) * tilesX + (x >> TILE_SHIFT);
+        return (tile << (2*TILE_SHIFT)) | ((y & TILE_MASK) << TILE_SHIFT) | (x & TILE_MASK);
+    }
+
+    void hit(int x, int y)
+    {
+        ++bins[index(tilesX, x, y)];
+    }
+
+    std::uint32_t count(int x, int y) const
+    {
+        return bins[index(tilesX, x, y)];
+    }
+};
+
+
+struct TrajectoryStats
+{
+    std::uint64_t points = 0;
+    std::uint64_t hits = 0;
+    bool diverged = false;
+};
+
+
+static int PrintUsage();
+static bool ParseArg(const char *arg, DensityOptions& options);
+
+
+static TrajectoryStats RunTrajectory(
+    const char *kind,
+    const DensityOptions& options,
+    const PlotView& view,
+    const std::optional<Analog::StateCache>& cache,
+    std::size_t job,
+    std::uint64_t points,
+    TiledHistogram& hist)
+{
+    using namespace Analog;
+
+    TrajectoryStats stats;
+    auto osc = MakeChaoticOscillator(kind);
+    LoadRangeTable(*osc, kind);
+    osc->setKnob(options.knob);
+
+    // Start each trajectory somewhere different on the attractor. The cache holds
+    // only a few states, so jobs can share one: the offset keeps their orbits apart.
+    const bool warm = cache && WarmStart(*osc, *cache, 0x9e3779b97f4a7c15ull * (job + 1));
+    const double offset = 1.0e-3 * (job + 1);
+    osc->setState(osc->rx() + offset, osc->ry(), osc->rz());
+    if (!warm && options.settleSeconds > 0.0)
+    {
+        float x, y, z;
+        osc->processDense(&x, &y, &z, 1, options.settleSeconds);
+    }
+
+    const float fw = static_cast<float>(hist.width);
+    const float fh = static_cast<float>(hist.height);
+    const std::size_t BLOCK = 4096;
+    float bx[BLOCK], by[BLOCK], bz[BLOCK];
+    while (stats.points < points)
+    {
+        const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(BLOCK, points - stats.points));
+        osc->processDense(bx, by, bz, n, options.interval);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            float u, v;
+            view.project(bx[i], by[i], bz[i], u, v);
+            u *= fw;
+            v *= fh;
+            // The comparisons also reject NaN.
+            if (u >= 0.0f && u < fw && v >= 0.0f && v < fh)
+            {
+                hist.hit(static_cast<int>(u), static_cast<int>(v));
+                ++stats.hits;
+            }
+        }
+        stats.points += n;
+        if (!std::isfinite(bx[n-1]) || !std::isfinite(by[n-1]) || !std::isfinite(bz[n-1]))
+        {
+            stats.diverged = true;
+            break;
+        }
+    }
+    return stats;
+}
+
+
+// Black through the trail's green to white, on a log scale of hit counts.
+static void ToneMap(const std::vector<std::uint64_t>& counts, std::vector<std::uint8_t>& rgb)
+{
+    const std::uint64_t peak = *std::max_element(counts.begin(), counts.end());
+    const double scale = (peak > 0) ? 1.0 / std::log1p(static_cast<double>(peak)) : 0.0;
+    rgb.resize(3 * counts.size());
+    for (std::size_t i = 0; i < counts.size(); ++i)
+    {
+        const double t = std::log1p(static_cast<double>(counts[i])) * scale;
+        const double lo = std::min(1.0, 2.0*t);
+        const double hi = std::max(0.0, 2.0*t - 1.0);
+        rgb[3*i + 0] = static_cast<std::uint8_t>(std::lround(255.0 * hi));
+        rgb[3*i + 1] = static_cast<std::uint8_t>(std::lround(228.0 * lo + 27.0 * hi));
+        rgb[3*i + 2] = static_cast<std::uint8_t>(std::lround(48.0 * lo + 207.0 * hi));
+    }
+}
+
+
+int main(int argc, const char *argv[])
+{
+    using namespace Analog;
+
+    if (argc < 2)
+        return PrintUsage();
+
+    const char *kind = argv[1];
+    auto probe = MakeChaoticOscillator(kind);
+    if (probe == nullptr)
+    {
+        printf("ERROR: Unknown chaotic oscillator kind '%s'\n", kind);
+        return 1;
+    }
+
+    DensityOptions options;
+    for (int i = 2; i < argc; ++i)
+        if (!ParseArg(argv[i], options))
+            return 1;
+
+    if (options.interval == 0.0)
+    {
+        LoadRangeTable(*probe, kind);
+        options.interval = probe->maxStep() / 4;
+        if (options.interval <= 0.0)
+        {
+            printf("ERROR: %s has no maximum time step; specify interval=s.\n", kind);
+            return 1;
+        }
+    }
+
+    if (options.out.empty())
+        options.out = std::string(kind) + ".png";
+    if (options.trajectories == 0)
+        options.trajectories = 4 * static_cast<int>(options.threads);
+
+    PlotView view;
+    view.rotateX(options.rotateX * (M_PI / 180.0));
+    view.rotateY(options.rotateY * (M_PI / 180.0));
+
+    const std::optional<StateCache> cache = LoadStateCache(kind);
+    const std::uint64_t total = static_cast<std::uint64_t>(options.points);
+    const std::size_t jobs = static_cast<std::size_t>(options.trajectories);
+    std::vector<TiledHistogram> hists(options.threads, TiledHistogram(options.width, options.height));
+    std::vector<TrajectoryStats> stats(jobs);
+
+    printf("Rendering %llu points of %s in %zu trajectories on %u threads%s...\n",
+        static_cast<unsigned long long>(total), kind, jobs, options.threads,
+        cache ? " (warm start)" : "");
+    fflush(stdout);
+
+    auto start = std::chrono::steady_clock::now();
+    ParallelFor(jobs, options.threads, [&](std::size_t job, unsigned worker)
+    {
+        const std::uint64_t points = total / jobs + (job < total % jobs ? 1 : 0);
+        stats[job] = RunTrajectory(kind, options, view, cache, job, points, hists[worker]);
+    });
+    auto simulated = std::chrono::steady_clock::now();
+
+    // Sum the per-thread histograms into a plain row-major image, one image row per task.
+    std::vector<std::uint64_t> counts(static_cast<std::size_t>(options.width) * options.height);
+    ParallelFor(options.height, options.threads, [&](std::size_t y, unsigned)
+    {
+        std::uint64_t *row = &counts[y * options.width];
+        for (const TiledHistogram& h : hists)
+            for (int x = 0; x < options.width; ++x)
+                row[x] += h.count(x, static_cast<int>(y));
+    });
+    std::vector<std::uint8_t> rgb;
+    ToneMap(counts, rgb);
+    auto merged = std::chrono::steady_clock::now();
+
+    std::uint64_t points = 0, hits = 0;
+    int diverged = 0;
+    for (const TrajectoryStats& s : stats)
+    {
+        points += s.points;
+        hits += s.hits;
+        diverged += s.diverged ? 1 : 0;
+    }
+
+    const double simSeconds = std::chrono::duration<double>(simulated - start).count();
+    const double mergeSeconds = std::chrono::duration<double>(merged - simulated).count();
+    printf("Simulated %llu points in %0.3lf seconds = %0.1lf million points/second.\n",
+        static_cast<unsigned long long>(points), simSeconds, 1.0e-6 * points / simSeconds);
+    printf("%0.2lf%% of points landed in the image. Merge and tone map took %0.3lf seconds.\n",
+        (points > 0) ? 100.0 * hits / points : 0.0, mergeSeconds);
+    if (diverged > 0)
+        printf("WARNING: %d of %zu trajectories diverged.\n", diverged, jobs);
+
+    if (!SavePng(options.out.c_str(), options.width, options.height, rgb))
+        return 1;
+    printf("Wrote: %s\n", options.out.c_str());
+    return 0;
+}
+
+
+static int PrintUsage()
+{
+    printf(
+        "USAGE: density kind [options...]\n"
+        "\n"
+        "Renders the density of a chaotic oscillator's attractor to a PNG image.\n"
+        "The kind is one of:\n"
+    );
+    for (const char *kind : Analog::ChaoticOscillatorKinds)
+        printf("    %s\n", kind);
+    printf(
+        "\n"
+        "Options:\n"
+        "    width=n          image width in pixels (default 1024)\n"
+        "    height=n         image height in pixels (default 1024)\n"
+        "    points=n         total points to plot (default 1e9)\n"
+        "    knob=v           knob position in [-1, +1] (default 0)\n"
+        "    rotx=degrees     rotate the view about the horizontal axis (default 0)\n"
+        "    roty=degrees     rotate the view about the vertical axis (default 0)\n"
+        "    interval=s       simulated seconds between points (default: max_dt/4)\n"
+        "    settle=s         simulated seconds to settle each trajectory without a state cache (default 60)\n"
+        "    trajectories=n   independent trajectories (default: 4 per thread)\n"
+        "    threads=n        worker threads (default: all cores)\n"
+        "    out=file         output file (default kind.png)\n"
+        "\n"
+    );
+    return 1;
+}
+
+
+static bool ParseArg(const char *arg, DensityOptions& options)
+{
+    const char *eq = strchr(arg, '=');
+    if (eq == nullptr)
+    {
+        printf("ERROR: Invalid argument: %s\n", arg);
+        return false;
+    }
+
+    const std::string name(arg, eq - arg);
+    if (name == "out")
+    {
+        options.out = eq + 1;
+        if (options.out.empty())
+        {
+            printf("ERROR: Missing file name: %s\n", arg);
+            return false;
+        }
+        return true;
+    }
+
+    char *end = nullptr;
+    const double x = strtod(eq + 1, &end);
+    if (end == eq + 1 || *end != '\0' || !std::isfinite(x))
+    {
+        printf("ERROR: Invalid number in argument: %s\n", arg);
+        return false;
+    }
+
+    if (name == "width" && x >= 1 && x <= 16384)
+        options.width = static_cast<int>(x);
+    else if (name == "height" && x >= 1 && x <= 16384)
+        options.height = static_cast<int>(x);
+    else if (name == "points" && x >= 1)
+        options.points = x;
+    else if (name == "knob" && x >= -1 && x <= +1)
+        options.knob = x;
+    else if (name == "rotx")
+        options.rotateX = x;
+    else if (name == "roty")
+        options.rotateY = x;
+    else if (name == "interval" && x > 0)
+        options.interval = x;
+    else if (name == "settle" && x >= 0)
+        options.settleSeconds = x;
+    else if (name == "trajectories" && x >= 1)
+        options.trajectories = static_cast<int>(x);
+    else if (name == "threads" && x >= 1)
+        options.threads = static_cast<unsigned>(x);
+    else
+    {
+        printf("ERROR: Invalid argument: %s\n", arg);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,383 @@
+/*
+    jerksweep.cpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Sweeps JerkCircuit over a grid of time dilations and component values,
+    using all CPU cores, and writes a binary bifurcation table: for each
+    configuration, the peaks and troughs of xVoltage() after it settles.
+
+    Output file format (native byte order, little-endian on x86 and ARM):
+
+        Header:
+            char    magic[8]        "JERKSWP1"
+            uint32  axisCount       10
+            uint32  peaksPerRecord  K
+            double  sampleRate
+            double  settleSeconds
+            double  recordSeconds
+            axisCount times, in the order td R1 R2 R3 R4 R5 R6 C1 C2 C3:
+                char    name[4]     NUL padded
+                double  lo
+                double  hi          value at step j is lo + (hi-lo)*j/(steps-1)
+                uint32  steps       1 for an axis held at its nominal value
+                uint32  reserved    0
+            uint64  recordCount     product of all steps
+
+        recordCount records, with the last axis (C3) varying fastest:
+            uint32  peakCount       0xffffffff if the circuit diverged
+            uint32  troughCount
+            float   peakMin
+            float   peakMax
+            float   troughMin
+            float   troughMax
+            float   peaks[K]        the first K peaks; NaN past peakCount
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include "JerkCircuit.hpp"
+#include "Parallel.hpp"
+
+struct Axis
+{
+    const char *name;
+    double lo;
+    double hi;
+    std::uint32_t steps;
+
+    double value(std::uint32_t j) const
+    {
+        return (steps > 1) ? lo + (hi - lo)*j/(steps - 1) : lo;
+    }
+};
+
+struct SweepOptions
+{
+    double sampleRate = 44100;
+    double settleSeconds = 1;
+    double recordSeconds = 2;
+    double w0 = 0.0;
+    double x0 = 0.1;
+    double y0 = 0.0;
+    unsigned threads = Analog::DefaultThreadCount();
+    std::uint32_t peaks = 16;
+    Analog::JerkSolver solver = Analog::JerkSolver::Newton;
+};
+
+const std::uint32_t DIVERGED = 0xffffffff;
+const double DIVERGENCE_VOLTS = 100.0;
+const std::uint32_t MAX_AXIS_STEPS = 1000000;
+const std::uint64_t MAX_TABLE_BYTES = 0x100000000;      // 4 GiB, held in memory until the sweep finishes
+
+static int PrintUsage();
+static bool ParseArg(const char *arg, std::vector<Axis>& axes, SweepOptions& options);
+static void RunConfiguration(const std::vector<Axis>& axes, const SweepOptions& options, std::uint64_t index, unsigned char *record);
+static bool WriteTable(const char *filename, const std::vector<Axis>& axes, const SweepOptions& options, const std::vector<unsigned char>& table);
+
+int main(int argc, const char *argv[])
+{
+    using namespace Analog;
+
+    if (argc < 2)
+        return PrintUsage();
+
+    const JerkComponents nominal;
+    std::vector<Axis> axes
+    {
+        { "td", 1.0,        1.0,        1 },
+        { "R1", nominal.R1, nominal.R1, 1 },
+        { "R2", nominal.R2, nominal.R2, 1 },
+        { "R3", nominal.R3, nominal.R3, 1 },
+        { "R4", nominal.R4, nominal.R4, 1 },
+        { "R5", nominal.R5, nominal.R5, 1 },
+        { "R6", nominal.R6, nominal.R6, 1 },
+        { "C1", nominal.C1, nominal.C1, 1 },
+        { "C2", nominal.C2, nominal.C2, 1 },
+        { "C3", nominal.C3, nominal.C3, 1 },
+    };
+
+    SweepOptions options;
+    for (int i = 2; i < argc; ++i)
+        if (!ParseArg(argv[i], axes, options))
+            return 1;
+
+    // Refuse sweeps whose table would not fit in memory, before the product can overflow.
+    const std::size_t recordBytes = 24 + 4*options.peaks;
+    const std::uint64_t maxCount = MAX_TABLE_BYTES / recordBytes;
+    std::uint64_t count = 1;
+    for (const Axis& a : axes)
+    {
+        if (count > maxCount / a.steps)
+        {
+            printf("ERROR: The sweep has too many configurations; its table would exceed %llu bytes.\n",
+                static_cast<unsigned long long>(MAX_TABLE_BYTES));
+            return 1;
+        }
+        count *= a.steps;
+    }
+
+    std::vector<unsigned char> table(count * recordBytes);
+
+    printf("Sweeping %llu configurations on %u threads...\n", static_cast<unsigned long long>(count), options.threads);
+    auto start = std::chrono::steady_clock::now();
+    ParallelFor(count, options.threads, [&](std::size_t index, unsigned)
+    {
+        RunConfiguration(axes, options, index, &table[index * recordBytes]);
+    });
+    auto stop = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(stop - start).count();
+
+    std::uint64_t diverged = 0;
+    for (std::uint64_t i = 0; i < count; ++i)
+    {
+        std::uint32_t peakCount;
+        memcpy(&peakCount, &table[i * recordBytes], sizeof(peakCount));
+        if (peakCount == DIVERGED)
+            ++diverged;
+    }
+
+    printf("Finished in %0.3f seconds (%0.1f configurations/second); %llu diverged.\n",
+        elapsed, count / elapsed, static_cast<unsigned long long>(diverged));
+
+    if (!WriteTable(argv[1], axes, options, table))
+        return 1;
+
+    printf("Wrote: %s\n", argv[1]);
+    return 0;
+}
+
+
+static int PrintUsage()
+{
+    printf("USAGE: jerksweep outfile.bin [axis=lo:hi:steps ...] [option=value ...]\n");
+    printf("\n");
+    printf("Axes are td (time dilation), R1..R6 (ohms), and C1..C3 (farads).\n");
+    printf("An axis not given is held at its nominal value.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("    rate=Hz        sample rate (default 44100)\n");
+    printf("    settle=sec     simulated time to let transients die out (default 1)\n");
+    printf("    record=sec     simulated time to collect peaks and troughs (default 2)\n");
+    printf("    peaks=K        peaks stored per configuration (default 16)\n");
+    printf("    threads=N      worker threads (default: all cores)\n");
+    printf("    solver=S       newton (default) or fixed\n");
+    printf("    w0=V x0=V y0=V initial capacitor voltages (default 0, 0.1, 0)\n");
+    printf("\n");
+    printf("Example: jerksweep sweep.bin td=0.5:3:100 R5=500:2000:100\n");
+    return 1;
+}
+
+
+static bool ParseArg(const char *arg, std::vector<Axis>& axes, SweepOptions& options)
+{
+    const char *eq = strchr(arg, '=');
+    if (eq == nullptr)
+    {
+        printf("ERROR: Expected name=value but found: %s\n", arg);
+        return false;
+    }
+    const std::string name(arg, eq - arg);
+    const char *value = eq + 1;
+
+    for (Axis& a : axes)
+    {
+        if (name == a.name)
+        {
+            long long steps;
+            int length = 0;
+            if (3 != sscanf(value, "%lf:%lf:%lld%n", &a.lo, &a.hi, &steps, &length) || value[length] != '\0' ||
+                steps < 1 || steps > MAX_AXIS_STEPS || !(a.lo > 0.0) || !(a.hi > 0.0) || !std::isfinite(a.hi))
+            {
+                printf("ERROR: Expected %s=lo:hi:steps with positive values and 1 <= steps <= %u, but found: %s\n",
+                    a.name, MAX_AXIS_STEPS, value);
+                return false;
+            }
+            a.steps = static_cast<std::uint32_t>(steps);
+            return true;
+        }
+    }
+
+    if (name == "solver")
+    {
+        if (!strcmp(value, "newton"))
+            options.solver = Analog::JerkSolver::Newton;
+        else if (!strcmp(value, "fixed"))
+            options.solver = Analog::JerkSolver::FixedPoint;
+        else
+        {
+            printf("ERROR: Unknown solver: %s\n", value);
+            return false;
+        }
+        return true;
+    }
+
+    char *end;
+    const double x = strtod(value, &end);
+    if (end == value || *end != '\0' || !std::isfinite(x))
+    {
+        printf("ERROR: Invalid number in: %s\n", arg);
+        return false;
+    }
+
+    if (name == "rate" && x > 0.0)
+        options.sampleRate = x;
+    else if (name == "settle" && x >= 0.0)
+        options.settleSeconds = x;
+    else if (name == "record" && x > 0.0)
+        options.recordSeconds = x;
+    else if (name == "peaks" && x >= 0.0 && x <= 1024.0)
+        options.peaks = static_cast<std::uint32_t>(x);
+    else if (name == "threads" && x >= 1.0 && x <= 1024.0)
+        options.threads = static_cast<unsigned>(x);
+    else if (name == "w0")
+        options.w0 = x;
+    else if (name == "x0")
+        options.x0 = x;
+    else if (name == "y0")
+        options.y0 = x;
+    else
+    {
+        printf("ERROR: Unknown or out-of-range option: %s\n", arg);
+        return false;
+    }
+    return true;
+}
+
+
+static void RunConfiguration(const std::vector<Axis>& axes, const SweepOptions& options, std::uint64_t index, unsigned char *record)
+{
+    using namespace Analog;
+
+    // Decode the record index into a value for each axis, the last axis varying fastest.
+    double value[10];
+    for (int k = static_cast<int>(axes.size()) - 1; k >= 0; --k)
+    {
+        value[k] = axes[k].value(static_cast<std::uint32_t>(index % axes[k].steps));
+        index /= axes[k].steps;
+    }
+
+    JerkComponents parts;
+    parts.R1 = value[1];
+    parts.R2 = value[2];
+    parts.R3 = value[3];
+    parts.R4 = value[4];
+    parts.R5 = value[5];
+    parts.R6 = value[6];
+    parts.C1 = value[7];
+    parts.C2 = value[8];
+    parts.C3 = value[9];
+
+    JerkCircuit circuit(value[0], options.w0, options.x0, options.y0, parts);
+    circuit.setSolver(options.solver);
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    std::uint32_t peakCount = 0;
+    std::uint32_t troughCount = 0;
+    float peakMin = nan, peakMax = nan, troughMin = nan, troughMax = nan;
+    std::vector<float> peaks(options.peaks, nan);
+
+    const float sampleRate = static_cast<float>(options.sampleRate);
+    const long settle = static_cast<long>(options.settleSeconds * options.sampleRate);
+    const long total = settle + static_cast<long>(options.recordSeconds * options.sampleRate);
+    double x1 = 0.0;    // x one sample ago
+    double x2 = 0.0;    // x two samples ago
+    for (long n = 0; n < total; ++n)
+    {
+        circuit.update(sampleRate);
+        const double x = circuit.xVoltage();
+        if (!std::isfinite(x) || std::abs(x) > DIVERGENCE_VOLTS)
+        {
+            peakCount = DIVERGED;
+            break;
+        }
+
+        if (n >= settle + 2)
+        {
+            if (x1 > x2 && x1 >= x)
+            {
+                const float p = static_cast<float>(x1);
+                if (peakCount < options.peaks)
+                    peaks[peakCount] = p;
+                peakMin = (peakCount == 0) ? p : std::min(peakMin, p);
+                peakMax = (peakCount == 0) ? p : std::max(peakMax, p);
+                ++peakCount;
+            }
+            else if (x1 < x2 && x1 <= x)
+            {
+                const float t = static_cast<float>(x1);
+                troughMin = (troughCount == 0) ? t : std::min(troughMin, t);
+                troughMax = (troughCount == 0) ? t : std::max(troughMax, t);
+                ++troughCount;
+            }
+        }
+        x2 = x1;
+        x1 = x;
+    }
+
+    if (peakCount == DIVERGED)
+    {
+        troughCount = 0;
+        peakMin = peakMax = troughMin = troughMax = nan;
+        std::fill(peaks.begin(), peaks.end(), nan);
+    }
+
+    memcpy(record +  0, &peakCount,   4);
+    memcpy(record +  4, &troughCount, 4);
+    memcpy(record +  8, &peakMin,     4);
+    memcpy(record + 12, &peakMax,     4);
+    memcpy(record + 16, &troughMin,   4);
+    memcpy(record + 20, &troughMax,   4);
+    if (options.peaks > 0)
+        memcpy(record + 24, peaks.data(), 4*options.peaks);
+}
+
+
+static bool WriteTable(const char *filename, const std::vector<Axis>& axes, const SweepOptions& options, const std::vector<unsigned char>& table)
+{
+    FILE *outfile = fopen(filename, "wb");
+    if (outfile == nullptr)
+    {
+        printf("ERROR: Cannot open output file: %s\n", filename);
+        return false;
+    }
+
+    std::uint64_t count = 1;
+    for (const Axis& a : axes)
+        count *= a.steps;
+
+    const std::uint32_t axisCount = static_cast<std::uint32_t>(axes.size());
+    const std::uint32_t reserved = 0;
+    fwrite("JERKSWP1", 1, 8, outfile);
+    fwrite(&axisCount, sizeof(axisCount), 1, outfile);
+    fwrite(&options.peaks, sizeof(options.peaks), 1, outfile);
+    fwrite(&options.sampleRate, sizeof(options.sampleRate), 1, outfile);
+    fwrite(&options.settleSeconds, sizeof(options.settleSeconds), 1, outfile);
+    fwrite(&options.recordSeconds, sizeof(options.recordSeconds), 1, outfile);
+    for (const Axis& a : axes)
+    {
+        char name[4] = {};
+        memcpy(name, a.name, std::min(sizeof(name), strlen(a.name)));
+        fwrite(name, 1, sizeof(name), outfile);
+        fwrite(&a.lo, sizeof(a.lo), 1, outfile);
+        fwrite(&a.hi, sizeof(a.hi), 1, outfile);
+        fwrite(&a.steps, sizeof(a.steps), 1, outfile);
+        fwrite(&reserved, sizeof(reserved), 1, outfile);
+    }
+    fwrite(&count, sizeof(count), 1, outfile);
+    fwrite(table.data(), 1, table.size(), outfile);
+
+    const bool ok = !ferror(outfile);
+    if (fclose(outfile) != 0 || !ok)
+    {
+        printf("ERROR: Failed writing output file: %s\n", filename);
+        return false;
+    }
+    return true;
+}
@@ -2,8 +2,11 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <vector>
 #include "raylib.h"
+#include "rlgl.h"
+#include "Projection.hpp"
 
 const int SCREEN_WIDTH  = 800;
 const int SCREEN_HEIGHT = 800;
@@ -11,9 +14,6 @@ const int SAMPLE_RATE = 44100;
 const int FRAME_RATE = 60;
 const int SAMPLES_PER_FRAME = SAMPLE_RATE / FRAME_RATE;
 
-const double MIN_VOLTAGE = -5.5;
-const double MAX_VOLTAGE = +5.5;
-
 struct ScreenPoint
 {
     int sx;
@@ -25,33 +25,11 @@ struct ScreenPoint
         {}
 };
 
-struct PlotVector
+// A trail point already projected to screen coordinates.
+struct ScreenVertex
 {
-    double nx;
-    double ny;
-    double nz;
-
-    PlotVector(double _nx, double _ny, double _nz)
-        : nx(_nx)
-        , ny(_ny)
-        , nz(_nz)
-        {}
-
-    void rotateX(double c, double s)
-    {
-        double ry = c*ny - s*nz;
-        double rz = s*ny + c*nz;
-        ny = ry;
-        nz = rz;
-    }
-
-    void rotateY(double c, double s)
-    {
-        double rx = c*nx - s*nz;
-        double rz = s*nx + c*nz;
-        nx = rx;
-        nz = rz;
-    }
+    float sx;
+    float sy;
 };
 
 class Plotter
@@ -60,8 +38,19 @@ private:
     const std::size_t trailLength;
     std::size_t trailIndex = 0;
     std::vector<PlotVector> trail;
-    PlotVector xdir{1.0, 0.0, 0.0};
-    PlotVector ydir{0.0, 1.0, 0.0};
+    std::vector<ScreenVertex> screen;   // trail[i] projected with the current view
+    bool viewChanged = false;           // screen[] must be recomputed before plotting
+    PlotView view;
+
+    // rlgl's default batch holds 8192 quads = 32768 vertices; leave it room to spare.
+    static constexpr std::size_t SEGMENTS_PER_BATCH = 8192;
+
+    ScreenVertex projectVertex(const PlotVector& vec) const
+    {
+        double u, v;
+        view.project(vec.nx, vec.ny, vec.nz, u, v);
+        return ScreenVertex{static_cast<float>(u * SCREEN_WIDTH), static_cast<float>(v * SCREEN_HEIGHT)};
+    }
 
 public:
     explicit Plotter(int _trailLength)
@@ -70,27 +59,23 @@ public:
 
     void rotateX(double radians)
     {
-        double c = std::cos(radians);
-        double s = std::sin(radians);
-        xdir.rotateX(c, s);
-        ydir.rotateX(c, s);
+        view.rotateX(radians);
+        viewChanged = true;
     }
 
     void rotateY(double radians)
     {
-        double c = std::cos(radians);
-        double s = std::sin(radians);
-        xdir.rotateY(c, s);
-        ydir.rotateY(c, s);
+        view.rotateY(radians);
+        viewChanged = true;
     }
 
     ScreenPoint project(double vx, double vy, double vz) const
     {
-        double x = vx*xdir.nx + vy*xdir.ny + vz*xdir.nz;
-        double y = vx*ydir.nx + vy*ydir.ny + vz*ydir.nz;
+        double u, v;
+        view.project(vx, vy, vz, u, v);
         return ScreenPoint(
-            static_cast<int>(std::round(((x - MIN_VOLTAGE) / (MAX_VOLTAGE - MIN_VOLTAGE)) * SCREEN_WIDTH)),
-            static_cast<int>(std::round(((MAX_VOLTAGE - y) / (MAX_VOLTAGE - MIN_VOLTAGE)) * SCREEN_HEIGHT))
+            static_cast<int>(std::round(u * SCREEN_WIDTH)),
+            static_cast<int>(std::round(v * SCREEN_HEIGHT))
         );
     }
 
@@ -104,15 +89,39 @@ public:
         PlotVector current(vx, vy, vz);
 
         // On the first render, prefill the trail buffer.
-        while (trail.size() < trailLength)
-            trail.push_back(current);
+        if (trail.size() < trailLength)
+        {
+            trail.resize(trailLength, current);
+            screen.resize(trailLength, projectVertex(current));
+        }
+
+        // Only the new point needs projecting, unless the view has changed anyway.
+        trail[trailIndex] = current;
+        if (!viewChanged)
+            screen[trailIndex] = projectVertex(current);
+        if (++trailIndex == trailLength)
+            trailIndex = 0;
+    }
 
-        trail.at(trailIndex) = current;
-        trailIndex = (trailIndex + 1) % trailLength;
+    void clear()
+    {
+        trail.clear();
+        screen.clear();
+        trailIndex = 0;
     }
 
     void plot()
     {
+        if (trail.empty())
+            return;
+
+        if (viewChanged)
+        {
+            for (std::size_t i = 0; i < trailLength; ++i)
+                screen[i] = projectVertex(trail[i]);
+            viewChanged = false;
+        }
+
         Color color = BLACK;
         Color target = GREEN;
 
@@ -120,28 +129,39 @@ public:
         const std::size_t fadeInterval = std::max(std::size_t{1}, trailLength / (2 * fadeLength));
         std::size_t fadeCount = fadeInterval;
 
+        // Submit the trail, oldest point first, as line segments with per-vertex
+        // fade colors in a few large rlgl batches instead of one DrawLine per segment.
         std::size_t i = trailIndex;
-        while (true)
+        std::size_t remaining = trailLength - 1;
+        while (remaining > 0)
         {
-            std::size_t j = (i + 1) % trailLength;
-            if (j == trailIndex)
-                break;
-
-            ScreenPoint a = project(trail.at(i));
-            ScreenPoint b = project(trail.at(j));
-            DrawLine(a.sx, a.sy, b.sx, b.sy, color);
-            i = j;
-
-            if (--fadeCount == 0)
+            const std::size_t batch = std::min(remaining, SEGMENTS_PER_BATCH);
+            remaining -= batch;
+            rlCheckRenderBatchLimit(static_cast<int>(2 * batch));
+            rlBegin(RL_LINES);
+            for (std::size_t k = 0; k < batch; ++k)
             {
-                fadeCount = fadeInterval;
-                if (color.r < target.r) ++color.r;
-                if (color.g < target.g) ++color.g;
-                if (color.b < target.b) ++color.b;
+                std::size_t j = i + 1;
+                if (j == trailLength)
+                    j = 0;
+
+                rlColor4ub(color.r, color.g, color.b, color.a);
+                rlVertex2f(screen[i].sx, screen[i].sy);
+                rlVertex2f(screen[j].sx, screen[j].sy);
+                i = j;
+
+                if (--fadeCount == 0)
+                {
+                    fadeCount = fadeInterval;
+                    if (color.r < target.r) ++color.r;
+                    if (color.g < target.g) ++color.g;
+                    if (color.b < target.b) ++color.b;
+                }
             }
+            rlEnd();
         }
 
-        const PlotVector& current = trail.at((trailIndex + trailLength - 1) % trailLength);
+        const PlotVector& current = trail[(trailIndex + trailLength - 1) % trailLength];
         ScreenPoint s = project(current);
         DrawCircle(s.sx, s.sy, 2.0f, WHITE);
     }
@@ -160,6 +180,41 @@ public:
         DrawText(text, SCREEN_WIDTH-115, 5, 20, BROWN);
     }
 
+    void displayCounters(double substepsPerSample, double slopeCallsPerSample, int maxSubsteps, double microseconds)
+    {
+        // Instrumentation counters for the most recent frame, listed below the speed.
+        char text[50];
+        snprintf(text, sizeof(text), "steps: %6.2lf", substepsPerSample);
+        DrawText(text, SCREEN_WIDTH-160, 30, 20, DARKGRAY);
+        snprintf(text, sizeof(text), "slopes: %6.2lf", slopeCallsPerSample);
+        DrawText(text, SCREEN_WIDTH-160, 55, 20, DARKGRAY);
+        snprintf(text, sizeof(text), "max n: %4d", maxSubsteps);
+        DrawText(text, SCREEN_WIDTH-160, 80, 20, DARKGRAY);
+        snprintf(text, sizeof(text), "usec: %7.1lf", microseconds);
+        DrawText(text, SCREEN_WIDTH-160, 105, 20, DARKGRAY);
+    }
+
+    void displayAudioLoad(double meanMicros, double worstMicros, double budgetMicros)
+    {
+        // Audio callback time over the last second, below the knob.
+        char text[80];
+        snprintf(text, sizeof(text), "audio: %5.1lf us avg, %5.1lf max", meanMicros, worstMicros);
+        DrawText(text, 5, 30, 20, DARKGRAY);
+        snprintf(text, sizeof(text), "budget: %5.0lf us (%3.0lf%% used)", budgetMicros, 100.0 * worstMicros / budgetMicros);
+        DrawText(text, 5, 55, 20, DARKGRAY);
+    }
+
+    void displayPlayback(std::uint64_t position, std::uint64_t count, double seconds, double rate, bool playing)
+    {
+        char text[100];
+        snprintf(text, sizeof(text), "%s %llu / %llu  (t = %0.2lf s)  x%lg",
+            playing ? "PLAY" : "PAUSE",
+            static_cast<unsigned long long>(position),
+            static_cast<unsigned long long>(count),
+            seconds, rate);
+        DrawText(text, 5, SCREEN_HEIGHT-25, 20, BROWN);
+    }
+
     void displayFailureText()
     {
         DrawText("FAILURE", SCREEN_WIDTH/2 - 100, SCREEN_HEIGHT/2 - 10, 20, RED);
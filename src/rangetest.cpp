@@ -1,61 +1,164 @@
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
 #include "MakeChaoticOscillator.hpp"
+#include "Parallel.hpp"
+#include "StableStep.hpp"
+#include "StateCache.hpp"
 
-static int RangeTest(Analog::ChaoticOscillator& osc);
+const long SAMPLE_RATE = 44100;
+const long BLOCK_SIZE = 512;
+const long SETTLE_SECONDS = 60;
+const long CHECKPOINT_SECONDS = 3600;
 
-int main(int argc, const char *argv[])
+struct RangeOptions
+{
+    bool dense = false;
+    bool ensemble = false;
+    bool checkpoint = false;
+    unsigned threads = Analog::DefaultThreadCount();
+    unsigned members = 0;       // 0 = automatic
+};
+
+// Progress of the serial range test, saved every CHECKPOINT_SECONDS of simulation
+// to "<kind>.checkpoint" so an interrupted run can resume where it left off.
+struct Checkpoint
+{
+    Analog::OscillatorState state;
+    long done = 0;              // samples measured so far
+    double lo[3] {};
+    double hi[3] {};
+};
+
+static int RangeTest(Analog::ChaoticOscillator& osc, const char *kind, const RangeOptions& options);
+static int EnsembleRangeTest(const char *kind, const RangeOptions& options);
+static void PrintCounters(const Analog::ChaoticOscillator& osc);
+static int StableStepSearch(const char *kind, const RangeOptions& options);
+
+static int PrintUsage()
 {
     using namespace Analog;
 
-    if (argc != 2)
+    printf("USAGE: rangetest [kind | all] [dense] [ensemble] [checkpoint] [threads=n] [members=n]\n");
+    printf("\nwhere kind is one of:\n");
+    for (const char *kind : ChaoticOscillatorKinds)
+        printf("    %s\n", kind);
+    printf("\nThe 'dense' option integrates at each oscillator's maximum time step\n");
+    printf("and interpolates the audio samples in between.\n");
+    printf("\nThe 'ensemble' option runs many trajectories from perturbed initial conditions\n");
+    printf("on all cores (or 'threads'), stopping when the combined ranges stop growing,\n");
+    printf("instead of one 24-hour trajectory.\n");
+    printf("\nThe 'checkpoint' option saves the progress of the 24-hour trajectory\n");
+    printf("to kind.checkpoint every simulated hour, and resumes from that file if it exists.\n");
+    printf("\nIf the state cache kind.states exists (see calibrate), each trajectory\n");
+    printf("starts on the attractor and skips the %ld-second settle time.\n", SETTLE_SECONDS);
+    return 1;
+}
+
+static bool ParseOption(const char *arg, RangeOptions& options)
+{
+    if (!strcmp(arg, "dense"))
+    {
+        options.dense = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "ensemble"))
+    {
+        options.ensemble = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "checkpoint"))
     {
-        printf("USAGE: rangetest [kind | all]\n");
-        printf("\nwhere kind is one of:\n");
-        for (const char *kind : ChaoticOscillatorKinds)
-            printf("    %s\n", kind);
+        options.checkpoint = true;
+        return true;
+    }
+
+    int n;
+    char extra;
+    if (sscanf(arg, "threads=%d%c", &n, &extra) == 1 && n >= 1)
+    {
+        options.threads = static_cast<unsigned>(n);
+        return true;
+    }
+
+    if (sscanf(arg, "members=%d%c", &n, &extra) == 1 && n >= 2)
+    {
+        options.members = static_cast<unsigned>(n);
+        return true;
+    }
+
+    printf("ERROR: Invalid option: %s\n", arg);
+    return false;
+}
+
+static int RunKind(const char *kind, const RangeOptions& options)
+{
+    using namespace Analog;
+
+    if (MakeChaoticOscillator(kind) == nullptr)
+    {
+        printf("ERROR: Unknown chaotic oscillator kind '%s'\n", kind);
         return 1;
     }
 
+    int rc;
+    if (options.ensemble)
+    {
+        rc = EnsembleRangeTest(kind, options);
+    }
+    else
+    {
+        auto osc = MakeChaoticOscillator(kind);
+        if (LoadRangeTable(*osc, kind))
+            printf("Loaded range table for %s\n", kind);
+        rc = RangeTest(*osc, kind, options);
+    }
+    return (rc != 0) ? rc : StableStepSearch(kind, options);
+}
+
+int main(int argc, const char *argv[])
+{
+    using namespace Analog;
+
+    if (argc < 2)
+        return PrintUsage();
+
+    RangeOptions options;
+    for (int i = 2; i < argc; ++i)
+        if (!ParseOption(argv[i], options))
+            return PrintUsage();
+
     const char *kind = argv[1];
     int rc = 1;
     if (!strcmp(kind, "all"))
     {
         for (const char *oscKind : ChaoticOscillatorKinds)
         {
-            auto osc = MakeChaoticOscillator(oscKind);
-            if (!osc)
-            {
-                printf("INTERNAL ERROR: Unknown chaotic oscillator kind '%s'\n", kind);
-                return 1;
-            }
             printf("\nTesting: %s\n", oscKind);
-            rc = RangeTest(*osc);
+            rc = RunKind(oscKind, options);
             if (rc != 0)
                 break;
         }
     }
     else
     {
-        auto osc = MakeChaoticOscillator(kind);
-        if (!osc)
-        {
-            printf("ERROR: Unknown chaotic oscillator kind '%s'\n", kind);
-            return 1;
-        }
-        rc = RangeTest(*osc);
+        rc = RunKind(kind, options);
     }
     return rc;
 }
 
-static int CheckLimits(const Analog::ChaoticOscillator& osc)
+static int CheckLimits(const Analog::ChaoticOscillator& osc, double x, double y, double z)
 {
     const double LIMIT = osc.isTuned ? Analog::AMPLITUDE : 1000.0;
-    double x = osc.vx();
-    double y = osc.vy();
-    double z = osc.vz();
     if (!std::isfinite(x) || std::abs(x) > LIMIT)
     {
         printf("x is out of bounds: %lg\n", x);
@@ -74,9 +177,61 @@ static int CheckLimits(const Analog::ChaoticOscillator& osc)
     return 0;
 }
 
-static int RangeTest(Analog::ChaoticOscillator& osc)
+static bool LoadCheckpoint(const char *filename, const char *kind, bool dense, Checkpoint& cp)
+{
+    FILE *infile = fopen(filename, "rt");
+    if (infile == nullptr)
+        return false;
+
+    char name[64];
+    int denseFlag;
+    const bool ok =
+        fscanf(infile, " kind %63s dense %d", name, &denseFlag) == 2 &&
+        fscanf(infile, " state %lf %lf %lf %lf", &cp.state.x, &cp.state.y, &cp.state.z, &cp.state.knob) == 4 &&
+        fscanf(infile, " done %ld", &cp.done) == 1 &&
+        fscanf(infile, " range %lf %lf %lf %lf %lf %lf", &cp.lo[0], &cp.hi[0], &cp.lo[1], &cp.hi[1], &cp.lo[2], &cp.hi[2]) == 6;
+    fclose(infile);
+
+    if (!ok || strcmp(name, kind) || denseFlag != (dense ? 1 : 0) || cp.done <= 0)
+    {
+        printf("ERROR: Checkpoint file %s is invalid or belongs to a different test.\n", filename);
+        return false;
+    }
+    return true;
+}
+
+
+static bool SaveCheckpoint(const char *filename, const char *kind, bool dense, const Checkpoint& cp)
+{
+    // Write a new file and rename it over the old one, so an interruption
+    // while saving cannot destroy the previous checkpoint.
+    char tempname[120];
+    snprintf(tempname, sizeof(tempname), "%s.tmp", filename);
+    FILE *outfile = fopen(tempname, "wt");
+    if (outfile == nullptr)
+    {
+        printf("ERROR: Cannot open output file: %s\n", tempname);
+        return false;
+    }
+    fprintf(outfile, "kind %s dense %d\n", kind, dense ? 1 : 0);
+    fprintf(outfile, "state %0.17lg %0.17lg %0.17lg %0.17lg\n", cp.state.x, cp.state.y, cp.state.z, cp.state.knob);
+    fprintf(outfile, "done %ld\n", cp.done);
+    fprintf(outfile, "range %0.17lg %0.17lg %0.17lg %0.17lg %0.17lg %0.17lg\n", cp.lo[0], cp.hi[0], cp.lo[1], cp.hi[1], cp.lo[2], cp.hi[2]);
+    const bool ok = !ferror(outfile);
+    if (fclose(outfile) != 0 || !ok || rename(tempname, filename) != 0)
+    {
+        printf("ERROR: Failed writing checkpoint file: %s\n", filename);
+        return false;
+    }
+    return true;
+}
+
+
+static int RangeTest(Analog::ChaoticOscillator& osc, const char *kind, const RangeOptions& options)
 {
-    const long SAMPLE_RATE = 44100;
+    using namespace Analog;
+
+    const bool dense = options.dense;
     const long SIM_SECONDS = 24 * 3600;
     const long SIM_SAMPLES = SIM_SECONDS * SAMPLE_RATE;
     const double dt = 1.0 / SAMPLE_RATE;
@@ -88,77 +243,324 @@ static int RangeTest(Analog::ChaoticOscillator& osc)
     double zMin = 0;
     double zMax = 0;
 
-    const long SETTLE_SECONDS = 60;
-    const long SETTLE_SAMPLES = SETTLE_SECONDS * SAMPLE_RATE;
-    for (long i = 0; i < SETTLE_SAMPLES; ++i)
+    // Render in blocks so the oscillator can hoist its per-sample overhead.
+    double bx[BLOCK_SIZE];
+    double by[BLOCK_SIZE];
+    double bz[BLOCK_SIZE];
+
+    char checkpointFileName[100];
+    snprintf(checkpointFileName, sizeof(checkpointFileName), "%s.checkpoint", kind);
+    Checkpoint cp;
+    long start = 0;
+    if (options.checkpoint && LoadCheckpoint(checkpointFileName, kind, dense, cp))
+    {
+        osc.restoreState(cp.state);
+        start = cp.done;
+        xMin = cp.lo[0];  xMax = cp.hi[0];
+        yMin = cp.lo[1];  yMax = cp.hi[1];
+        zMin = cp.lo[2];  zMax = cp.hi[2];
+        printf("Resuming from %s after %ld samples.\n", checkpointFileName, start);
+    }
+
+    // Start on the attractor if we can, instead of waiting for the transient to die away.
+    bool warm = false;
+    if (start == 0)
     {
-        osc.update(dt);
-        if (CheckLimits(osc)) return 1;
+        const std::optional<StateCache> cache = LoadStateCache(kind);
+        warm = cache && WarmStart(osc, *cache, 0);
+        if (warm)
+            printf("Warm start from %s.states\n", kind);
+    }
+
+    const long SETTLE_SAMPLES = (start > 0 || warm) ? 0 : SETTLE_SECONDS * SAMPLE_RATE;
+    for (long i = 0; i < SETTLE_SAMPLES; i += BLOCK_SIZE)
+    {
+        const long frames = std::min(BLOCK_SIZE, SETTLE_SAMPLES - i);
+        if (dense)
+            osc.processDense(bx, by, bz, frames, dt);
+        else
+            osc.process(bx, by, bz, frames, dt);
+        for (long f = 0; f < frames; ++f)
+            if (CheckLimits(osc, bx[f], by[f], bz[f])) return 1;
     }
 
-    printf("Settled  at: rx=%10.6lf, ry=%10.6lf, rz=%10.6lf\n", osc.rx(), osc.ry(), osc.rz());
+    if (start == 0)
+        printf("Settled  at: rx=%10.6lf, ry=%10.6lf, rz=%10.6lf\n", osc.rx(), osc.ry(), osc.rz());
+    osc.resetCounters();
 
-    for (long i = 0; i < SIM_SAMPLES; ++i)
+    const long CHECKPOINT_SAMPLES = CHECKPOINT_SECONDS * SAMPLE_RATE;
+    long nextCheckpoint = start + CHECKPOINT_SAMPLES;
+    for (long i = start; i < SIM_SAMPLES; i += BLOCK_SIZE)
     {
-        osc.update(dt);
-        if (CheckLimits(osc)) return 1;
-        if (i == 0)
+        const long frames = std::min(BLOCK_SIZE, SIM_SAMPLES - i);
+        if (dense)
+            osc.processDense(bx, by, bz, frames, dt);
+        else
+            osc.process(bx, by, bz, frames, dt);
+        for (long f = 0; f < frames; ++f)
         {
-            xMin = xMax = osc.vx();
-            yMin = yMax = osc.vy();
-            zMin = zMax = osc.vz();
+            if (CheckLimits(osc, bx[f], by[f], bz[f])) return 1;
+            if (i + f == 0)
+            {
+                xMin = xMax = bx[f];
+                yMin = yMax = by[f];
+                zMin = zMax = bz[f];
+            }
+            else
+            {
+                xMin = std::min(xMin, bx[f]);
+                xMax = std::max(xMax, bx[f]);
+                yMin = std::min(yMin, by[f]);
+                yMax = std::max(yMax, by[f]);
+                zMin = std::min(zMin, bz[f]);
+                zMax = std::max(zMax, bz[f]);
+            }
         }
-        else
+
+        if (options.checkpoint && i + frames >= nextCheckpoint && i + frames < SIM_SAMPLES)
         {
-            xMin = std::min(xMin, osc.vx());
-            xMax = std::max(xMax, osc.vx());
-            yMin = std::min(yMin, osc.vy());
-            yMax = std::max(yMax, osc.vy());
-            zMin = std::min(zMin, osc.vz());
-            zMax = std::max(zMax, osc.vz());
+            cp.state = osc.saveState();
+            cp.done = i + frames;
+            cp.lo[0] = xMin;  cp.hi[0] = xMax;
+            cp.lo[1] = yMin;  cp.hi[1] = yMax;
+            cp.lo[2] = zMin;  cp.hi[2] = zMax;
+            if (!SaveCheckpoint(checkpointFileName, kind, dense, cp))
+                return 1;
+            nextCheckpoint += CHECKPOINT_SAMPLES;
         }
     }
 
+    if (options.checkpoint)
+        remove(checkpointFileName);
+
     printf("Finished at: rx=%10.6lf, ry=%10.6lf, rz=%10.6lf\n", osc.rx(), osc.ry(), osc.rz());
 
     printf("vx range: %10.6lf %10.6lf\n", xMin, xMax);
     printf("vy range: %10.6lf %10.6lf\n", yMin, yMax);
     printf("vz range: %10.6lf %10.6lf\n", zMin, zMax);
 
-    if (osc.isTuned && !osc.hasStabilityProtection())
+    PrintCounters(osc);
+    return 0;
+}
+
+
+struct EnsembleMember
+{
+    std::unique_ptr<Analog::ChaoticOscillator> osc;
+    double lo[3];
+    double hi[3];
+    bool failed = false;
+
+    EnsembleMember()
     {
-        // Try larger and larger dt values until we find the limits of stability.
-        // Allow a tiny excess amplitude before we consider the simulation unstable.
-        printf("Searching for largest stable time step...\n");
-        const double limit = Analog::AMPLITUDE + 0.1;
-        const double dilate = 1.05;
-        const long STABLE_SAMPLES = 600 * SAMPLE_RATE;
-        for (double et = dt * dilate; et < 1.0; et *= dilate)
+        std::fill_n(lo, 3, +std::numeric_limits<double>::infinity());
+        std::fill_n(hi, 3, -std::numeric_limits<double>::infinity());
+    }
+
+    void run(bool dense, long samples, bool record)
+    {
+        const double dt = 1.0 / SAMPLE_RATE;
+        double b[3][BLOCK_SIZE];
+        for (long i = 0; i < samples; i += BLOCK_SIZE)
         {
-            //printf("Dilated time increment = %lg\n", et);
-            osc.initialize();
-            for (long i = 0; i < STABLE_SAMPLES; ++i)
+            const long frames = std::min(BLOCK_SIZE, samples - i);
+            if (dense)
+                osc->processDense(b[0], b[1], b[2], frames, dt);
+            else
+                osc->process(b[0], b[1], b[2], frames, dt);
+            for (long f = 0; f < frames; ++f)
             {
-                osc.update(et);
-                if (!std::isfinite(osc.vx()) || !std::isfinite(osc.vy()) || !std::isfinite(osc.vz()))
+                if (CheckLimits(*osc, b[0][f], b[1][f], b[2][f]))
                 {
-                    printf("Encountered non-finite voltage at sample %ld, et=%lg.\n", i, et);
-                    printf("Largest stable time step was: %lg\n", et/dilate);
-                    goto done;
+                    failed = true;
+                    return;
                 }
-                double r = std::abs(osc.vx());
-                r = std::max(r, std::abs(osc.vy()));
-                r = std::max(r, std::abs(osc.vz()));
-                if (r > limit)
+                if (record)
                 {
-                    printf("Encountered excessive value %lg at sample %ld, et=%lg.\n", r, i, et);
-                    printf("Largest stable time step was: %lg\n", et/dilate);
-                    goto done;
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        lo[c] = std::min(lo[c], b[c][f]);
+                        hi[c] = std::max(hi[c], b[c][f]);
+                    }
                 }
             }
         }
     }
-done:
+};
+
+
+static int EnsembleRangeTest(const char *kind, const RangeOptions& options)
+{
+    using namespace Analog;
+
+    // Every member runs ROUND_SECONDS per round. The run has converged when no
+    // combined bound has moved more than TOLERANCE volts for PATIENCE rounds in a row.
+    // The total simulated time never exceeds that of the serial 24-hour test.
+    const long ROUND_SECONDS = 60;
+    const double TOLERANCE = 1.0e-3;
+    const int PATIENCE = 5;
+    const double PERTURB = 1.0e-3;
+
+    const unsigned members = (options.members > 0) ? options.members : std::max(8u, 2*options.threads);
+    const long maxRounds = std::max(static_cast<long>(PATIENCE + 1), (24 * 3600) / (ROUND_SECONDS * static_cast<long>(members)));
+
+    const std::optional<StateCache> cache = LoadStateCache(kind);
+    bool warm = true;       // every member started from a cached state
+
+    std::vector<EnsembleMember> ensemble(members);
+    for (unsigned m = 0; m < members; ++m)
+    {
+        EnsembleMember& e = ensemble[m];
+        e.osc = MakeChaoticOscillator(kind);
+        if (!e.osc)
+        {
+            printf("ERROR: Unknown chaotic oscillator kind '%s'\n", kind);
+            return 1;
+        }
+        const bool loaded = LoadRangeTable(*e.osc, kind);
+        if (m == 0 && loaded)
+            printf("Loaded range table for %s\n", kind);
+
+        // With a state cache, every member starts from a cached point on the attractor.
+        // Otherwise member 0 starts from the usual initial conditions.
+        // Either way the rest are nudged off their start, because there are only so many
+        // cached states, and members sharing one would run identical trajectories.
+        warm = (cache && WarmStart(*e.osc, *cache, m)) && warm;
+        if (m > 0)
+        {
+            std::mt19937 rng(m);
+            std::uniform_real_distribution<double> nudge(-PERTURB, +PERTURB);
+            const double x = e.osc->rx() + nudge(rng);
+            const double y = e.osc->ry() + nudge(rng);
+            const double z = e.osc->rz() + nudge(rng);
+            e.osc->setState(x, y, z);
+        }
+    }
+
+    if (warm)
+        printf("Warm start from %s.states\n", kind);
+    const long settleSeconds = warm ? 0 : SETTLE_SECONDS;
+
+    auto failure = [&ensemble]()
+    {
+        return std::any_of(ensemble.begin(), ensemble.end(), [](const EnsembleMember& e) { return e.failed; });
+    };
+
+    printf("Ensemble of %u trajectories on %u threads.\n", members, options.threads);
+    auto start = std::chrono::steady_clock::now();
 
+    ParallelFor(members, options.threads, [&](std::size_t m, unsigned)
+    {
+        ensemble[m].run(options.dense, settleSeconds * SAMPLE_RATE, false);
+    });
+    if (failure())
+        return 1;
+
+    double lo[3], hi[3];
+    int stable = 0;
+    long rounds = 0;
+    while (rounds < maxRounds && stable < PATIENCE)
+    {
+        ParallelFor(members, options.threads, [&](std::size_t m, unsigned)
+        {
+            ensemble[m].run(options.dense, ROUND_SECONDS * SAMPLE_RATE, true);
+        });
+        if (failure())
+            return 1;
+
+        double change = 0.0;
+        for (int c = 0; c < 3; ++c)
+        {
+            double l = ensemble[0].lo[c];
+            double h = ensemble[0].hi[c];
+            for (const EnsembleMember& e : ensemble)
+            {
+                l = std::min(l, e.lo[c]);
+                h = std::max(h, e.hi[c]);
+            }
+            if (rounds > 0)
+                change = std::max({change, lo[c] - l, h - hi[c]});
+            lo[c] = l;
+            hi[c] = h;
+        }
+        ++rounds;
+        stable = (rounds > 1 && change <= TOLERANCE) ? (stable + 1) : 0;
+    }
+
+    auto finish = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(finish - start).count();
+    printf("%s after %ld rounds: %ld simulated seconds in %0.3lf seconds.\n",
+        (stable >= PATIENCE) ? "Converged" : "Stopped without converging",
+        rounds, (settleSeconds + rounds * ROUND_SECONDS) * members, elapsed);
+
+    printf("vx range: %10.6lf %10.6lf\n", lo[0], hi[0]);
+    printf("vy range: %10.6lf %10.6lf\n", lo[1], hi[1]);
+    printf("vz range: %10.6lf %10.6lf\n", lo[2], hi[2]);
+
+    // Confidence bounds: each interval spans the members' individual estimates,
+    // from the least extreme to the most extreme (the combined range above).
+    // Since the members are interchangeable, another trajectory of the same length
+    // would exceed the outer end with probability about 1/(members+1).
+    const char *name[3] = { "vx", "vy", "vz" };
+    for (int c = 0; c < 3; ++c)
+    {
+        double loInner = lo[c];
+        double hiInner = hi[c];
+        for (const EnsembleMember& e : ensemble)
+        {
+            loInner = std::max(loInner, e.lo[c]);
+            hiInner = std::min(hiInner, e.hi[c]);
+        }
+        printf("%s bounds: min [%10.6lf, %10.6lf]  max [%10.6lf, %10.6lf]\n", name[c], lo[c], loInner, hiInner, hi[c]);
+    }
+
+    PrintCounters(*ensemble[0].osc);
+    return 0;
+}
+
+
+static void PrintCounters(const Analog::ChaoticOscillator& osc)
+{
+    if constexpr (Analog::INSTRUMENTED)
+    {
+        const Analog::OscillatorCounters c = osc.snapshotCounters();
+        printf("Counters: samples=%ld, steps/sample=%0.4lf, slopes/sample=%0.4lf, max n=%d, out of bounds=%ld\n",
+            c.samples, c.substepsPerSample(), c.slopeCallsPerSample(), c.maxSubsteps, c.outOfBounds);
+        printf("Blocks: %ld, mean %0.3lf us, max %0.3lf us\n",
+            c.blocks, 1.0e6 * c.secondsPerBlock(), 1.0e6 * c.maxBlockSeconds);
+    }
+}
+
+
+static int StableStepSearch(const char *kind, const RangeOptions& options)
+{
+    using namespace Analog;
+
+    auto factory = [kind]()
+    {
+        auto osc = MakeChaoticOscillator(kind);
+        LoadRangeTable(*osc, kind);
+        return osc;
+    };
+
+    auto osc = factory();
+    if (!osc->isTuned)
+        return 0;
+
+    // Bisect for the limit of stability, trying several time steps at once.
+    // Allow a tiny excess amplitude before we consider the simulation unstable.
+    printf("Searching for largest stable time step...\n");
+    StableStepOptions search;
+    search.start = 1.0 / SAMPLE_RATE;
+    search.steps = 600 * SAMPLE_RATE;
+    search.threads = options.threads;
+    const StableStepResult result = FindStableStep(factory, search);
+    if (result.unstable == 0.0)
+        printf("No instability found up to et=%lg after %d trials.\n", search.ceiling, result.trials);
+    else
+        printf("Largest stable time step was: %lg (unstable at %lg, %d trials in %d batches)\n",
+            result.stable, result.unstable, result.trials, result.batches);
+    if (osc->hasStabilityProtection())
+        printf("Current max_dt is %lg.\n", osc->maxStep());
     return 0;
 }
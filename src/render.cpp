@@ -0,0 +1,450 @@
+/*
+    render.cpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Renders chaotic oscillator audio offline to 32-bit float WAV or raw files,
+    running the jobs listed in a job file concurrently on all CPU cores.
+
+    Job file: one job per line; '#' starts a comment. Each job is a list
+    of name=value fields separated by spaces, for example:
+
+        kind=ruck out=ruck.wav seconds=7200 rate=48000
+        kind=aiza out=aiza.raw seconds=600 speed=3 knob=0:-1,300:1,600:-1 channels=xz
+
+    Fields:
+        kind=k          oscillator kind (required)
+        out=file        output file (required): *.wav is a 32-bit float WAV file;
+                        anything else is raw interleaved native-endian 32-bit floats
+        seconds=s       duration of the output (required)
+        rate=hz         sample rate (default 44100)
+        speed=f         oscillator seconds per output second (default 1)
+        knob=v          constant knob position in [-1, +1] (default 0), or
+        knob=t:v,t:v    knob automation: positions at times in seconds,
+                        interpolated linearly and held past either end
+        channels=xyz    which outputs to write, in order (default xyz)
+        settle=s        oscillator seconds to run before recording (default 0)
+
+    Oscillators load their range tables (see RangeTable.hpp) when present.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "MakeChaoticOscillator.hpp"
+#include "Parallel.hpp"
+
+struct KnobPoint
+{
+    double time;
+    double value;
+};
+
+struct RenderJob
+{
+    int line = 0;
+    std::string kind;
+    std::string out;
+    double seconds = 0.0;
+    double rate = 44100.0;
+    double speed = 1.0;
+    double settle = 0.0;
+    std::vector<KnobPoint> knob { {0.0, 0.0} };
+    std::string channels = "xyz";
+
+    // Filled in by RenderOne().
+    bool ok = false;
+    double elapsed = 0.0;
+
+    long frames() const { return static_cast<long>(std::llround(seconds * rate)); }
+    bool isWav() const { return out.size() >= 4 && !strcmp(out.c_str() + out.size() - 4, ".wav"); }
+
+    double knobAt(double t) const
+    {
+        if (t <= knob.front().time)
+            return knob.front().value;
+        for (std::size_t i = 1; i < knob.size(); ++i)
+        {
+            if (t < knob[i].time)
+            {
+                const KnobPoint& a = knob[i-1];
+                const KnobPoint& b = knob[i];
+                return a.value + (b.value - a.value) * (t - a.time) / (b.time - a.time);
+            }
+        }
+        return knob.back().value;
+    }
+};
+
+// Frames rendered and written per block: large enough that each
+// write to the output file moves hundreds of kilobytes at once.
+const long BLOCK_FRAMES = 65536;
+
+static int PrintUsage();
+static bool ReadJobFile(const char *filename, std::vector<RenderJob>& jobs);
+static void RenderOne(RenderJob& job);
+
+int main(int argc, const char *argv[])
+{
+    using namespace Analog;
+
+    if (argc < 2)
+        return PrintUsage();
+
+    unsigned threads = DefaultThreadCount();
+    for (int i = 2; i < argc; ++i)
+    {
+        int n;
+        char extra;
+        if (sscanf(argv[i], "threads=%d%c", &n, &extra) == 1 && n >= 1)
+        {
+            threads = static_cast<unsigned>(n);
+        }
+        else
+        {
+            printf("ERROR: Invalid argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::vector<RenderJob> jobs;
+    if (!ReadJobFile(argv[1], jobs))
+        return 1;
+
+    printf("Rendering %zu job(s) on %u threads...\n", jobs.size(), threads);
+    auto start = std::chrono::steady_clock::now();
+    ParallelFor(jobs.size(), threads, [&jobs](std::size_t index, unsigned)
+    {
+        RenderOne(jobs[index]);
+    });
+    auto finish = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(finish - start).count();
+
+    double audioSeconds = 0.0;
+    int failures = 0;
+    for (const RenderJob& job : jobs)
+    {
+        if (job.ok)
+            audioSeconds += job.seconds;
+        else
+            ++failures;
+    }
+
+    printf("Finished %zu job(s) in %0.3lf seconds: %0.1lf seconds of audio, %0.1lfx real time overall.\n",
+        jobs.size() - failures, elapsed, audioSeconds, audioSeconds / elapsed);
+    if (failures > 0)
+    {
+        printf("ERROR: %d job(s) failed.\n", failures);
+        return 1;
+    }
+    return 0;
+}
+
+
+static int PrintUsage()
+{
+    printf("USAGE: render jobfile [threads=n]\n");
+    printf("\n");
+    printf("Renders every job in the job file, several at once.\n");
+    printf("Each line of the job file lists name=value fields:\n");
+    printf("\n");
+    printf("    kind=k          oscillator kind (required), one of:");
+    for (const char *kind : Analog::ChaoticOscillatorKinds)
+        printf(" %s", kind);
+    printf("\n");
+    printf("    out=file        output file (required): *.wav = 32-bit float WAV, else raw floats\n");
+    printf("    seconds=s       duration of the output (required)\n");
+    printf("    rate=hz         sample rate (default 44100)\n");
+    printf("    speed=f         oscillator seconds per output second (default 1)\n");
+    printf("    knob=v          constant knob position (default 0), or\n");
+    printf("    knob=t:v,t:v    knob positions at times in seconds, interpolated linearly\n");
+    printf("    channels=xyz    which outputs to write, in order (default xyz)\n");
+    printf("    settle=s        oscillator seconds to run before recording (default 0)\n");
+    printf("\n");
+    printf("Example line: kind=ruck out=ruck.wav seconds=3600 knob=0:-1,3600:1\n");
+    return 1;
+}
+
+
+static bool ParseKnob(const char *value, std::vector<KnobPoint>& knob)
+{
+    knob.clear();
+    if (strchr(value, ':') == nullptr)
+    {
+        char *end;
+        const double v = strtod(value, &end);
+        if (end == value || *end != '\0' || !(v >= -1.0 && v <= +1.0))
+            return false;
+        knob.push_back(KnobPoint{0.0, v});
+        return true;
+    }
+
+    const char *p = value;
+    while (true)
+    {
+        KnobPoint k;
+        int length;
+        if (sscanf(p, "%lf:%lf%n", &k.time, &k.value, &length) != 2)
+            return false;
+        if (!std::isfinite(k.time) || !(k.value >= -1.0 && k.value <= +1.0))
+            return false;
+        if (!knob.empty() && k.time <= knob.back().time)
+            return false;
+        knob.push_back(k);
+        p += length;
+        if (*p == '\0')
+            return true;
+        if (*p++ != ',')
+            return false;
+    }
+}
+
+
+static bool ParseField(const char *field, RenderJob& job)
+{
+    const char *eq = strchr(field, '=');
+    if (eq == nullptr)
+        return false;
+
+    const std::string name(field, eq - field);
+    const char *value = eq + 1;
+
+    if (name == "kind")
+    {
+        job.kind = value;
+        return Analog::MakeChaoticOscillator(value) != nullptr;
+    }
+
+    if (name == "out")
+    {
+        job.out = value;
+        return !job.out.empty();
+    }
+
+    if (name == "knob")
+        return ParseKnob(value, job.knob);
+
+    if (name == "channels")
+    {
+        job.channels = value;
+        if (job.channels.empty() || job.channels.size() > 3)
+            return false;
+        for (char c : job.channels)
+            if (c != 'x' && c != 'y' && c != 'z')
+                return false;
+        return true;
+    }
+
+    char *end;
+    const double x = strtod(value, &end);
+    if (end == value || *end != '\0' || !std::isfinite(x))
+        return false;
+
+    if (name == "seconds" && x > 0.0)
+        job.seconds = x;
+    else if (name == "rate" && x >= 1.0)
+        job.rate = x;
+    else if (name == "speed" && x > 0.0)
+        job.speed = x;
+    else if (name == "settle" && x >= 0.0)
+        job.settle = x;
+    else
+        return false;
+    return true;
+}
+
+
+static bool ReadJobFile(const char *filename, std::vector<RenderJob>& jobs)
+{
+    FILE *infile = fopen(filename, "rt");
+    if (infile == nullptr)
+    {
+        printf("ERROR: Cannot open job file: %s\n", filename);
+        return false;
+    }
+
+    bool ok = true;
+    int lnum = 0;
+    char line[1000];
+    while (ok && fgets(line, sizeof(line), infile))
+    {
+        ++lnum;
+        char *comment = strchr(line, '#');
+        if (comment != nullptr)
+            *comment = '\0';
+
+        RenderJob job;
+        job.line = lnum;
+        bool empty = true;
+        for (char *field = strtok(line, " \t\r\n"); ok && field != nullptr; field = strtok(nullptr, " \t\r\n"))
+        {
+            empty = false;
+            if (!ParseField(field, job))
+            {
+                printf("ERROR(%s line %d): Invalid field: %s\n", filename, lnum, field);
+                ok = false;
+            }
+        }
+        if (!ok || empty)
+            continue;
+
+        if (job.kind.empty() || job.out.empty() || job.seconds <= 0.0)
+        {
+            printf("ERROR(%s line %d): Each job needs kind, out, and seconds.\n", filename, lnum);
+            ok = false;
+        }
+        else if (job.isWav() && (job.rate != std::floor(job.rate) || job.rate > 0xffffffff))
+        {
+            printf("ERROR(%s line %d): WAV output needs a whole number sample rate.\n", filename, lnum);
+            ok = false;
+        }
+        else if (job.isWav() && 4.0 * job.channels.size() * job.frames() > 0xffffffff - 100.0)
+        {
+            printf("ERROR(%s line %d): Output is too large for a WAV file; use a raw file.\n", filename, lnum);
+            ok = false;
+        }
+        else
+        {
+            for (const RenderJob& other : jobs)
+            {
+                if (other.out == job.out)
+                {
+                    printf("ERROR(%s line %d): Output file %s is also written on line %d.\n", filename, lnum, job.out.c_str(), other.line);
+                    ok = false;
+                }
+            }
+            jobs.push_back(job);
+        }
+    }
+    fclose(infile);
+
+    if (ok && jobs.empty())
+    {
+        printf("ERROR: No jobs found in %s\n", filename);
+        ok = false;
+    }
+    return ok;
+}
+
+
+static void WriteLE(FILE *outfile, std::uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        fputc((value >> (8*i)) & 0xff, outfile);
+}
+
+
+static void WriteWavHeader(FILE *outfile, int channels, std::uint32_t rate, long frames)
+{
+    // WAVE_FORMAT_IEEE_FLOAT requires the extended fmt chunk and a fact chunk.
+    const std::uint32_t dataBytes = static_cast<std::uint32_t>(4 * channels * frames);
+    fwrite("RIFF", 1, 4, outfile);
+    WriteLE(outfile, 4 + (8 + 18) + (8 + 4) + (8 + dataBytes), 4);
+    fwrite("WAVE", 1, 4, outfile);
+
+    fwrite("fmt ", 1, 4, outfile);
+    WriteLE(outfile, 18, 4);
+    WriteLE(outfile, 3, 2);                     // WAVE_FORMAT_IEEE_FLOAT
+    WriteLE(outfile, channels, 2);
+    WriteLE(outfile, rate, 4);
+    WriteLE(outfile, rate * 4 * channels, 4);   // bytes per second
+    WriteLE(outfile, 4 * channels, 2);          // bytes per frame
+    WriteLE(outfile, 32, 2);                    // bits per sample
+    WriteLE(outfile, 0, 2);                     // no extension
+
+    fwrite("fact", 1, 4, outfile);
+    WriteLE(outfile, 4, 4);
+    WriteLE(outfile, static_cast<std::uint32_t>(frames), 4);
+
+    fwrite("data", 1, 4, outfile);
+    WriteLE(outfile, dataBytes, 4);
+}
+
+
+static void RenderOne(RenderJob& job)
+{
+    using namespace Analog;
+
+    auto start = std::chrono::steady_clock::now();
+    const char *out = job.out.c_str();
+
+    std::unique_ptr<ChaoticOscillator> osc = MakeChaoticOscillator(job.kind.c_str());
+    LoadRangeTable(*osc, job.kind.c_str());
+
+    FILE *outfile = fopen(out, "wb");
+    if (outfile == nullptr)
+    {
+        printf("ERROR: Cannot open output file: %s\n", out);
+        return;
+    }
+    // Every write is a whole block, so the stdio buffer would only add a copy.
+    setvbuf(outfile, nullptr, _IONBF, 0);
+
+    const int channels = static_cast<int>(job.channels.size());
+    const long frames = job.frames();
+    if (job.isWav())
+        WriteWavHeader(outfile, channels, static_cast<std::uint32_t>(job.rate), frames);
+
+    std::vector<float> bx(BLOCK_FRAMES);
+    std::vector<float> by(BLOCK_FRAMES);
+    std::vector<float> bz(BLOCK_FRAMES);
+    std::vector<float> knobIn(BLOCK_FRAMES);
+    std::vector<float> interleaved(BLOCK_FRAMES * channels);
+    const float *source[3];
+    for (int c = 0; c < channels; ++c)
+        source[c] = (job.channels[c] == 'x') ? bx.data() : (job.channels[c] == 'y') ? by.data() : bz.data();
+    const bool wantX = job.channels.find('x') != std::string::npos;
+    const bool wantY = job.channels.find('y') != std::string::npos;
+    const bool wantZ = job.channels.find('z') != std::string::npos;
+
+    const double dt = job.speed / job.rate;
+    const bool automated = (job.knob.size() > 1);
+    osc->setKnob(job.knob.front().value);
+
+    const long settleFrames = static_cast<long>(job.settle / dt);
+    for (long pos = 0; pos < settleFrames; pos += BLOCK_FRAMES)
+        osc->process(bx.data(), nullptr, nullptr, std::min(BLOCK_FRAMES, settleFrames - pos), dt);
+
+    bool ok = !ferror(outfile);
+    for (long pos = 0; ok && pos < frames; pos += BLOCK_FRAMES)
+    {
+        const long n = std::min(BLOCK_FRAMES, frames - pos);
+        float *px = wantX ? bx.data() : nullptr;
+        float *py = wantY ? by.data() : nullptr;
+        float *pz = wantZ ? bz.data() : nullptr;
+        if (automated)
+        {
+            for (long f = 0; f < n; ++f)
+                knobIn[f] = static_cast<float>(job.knobAt((pos + f) / job.rate));
+            osc->process(px, py, pz, knobIn.data(), n, dt);
+        }
+        else
+        {
+            osc->process(px, py, pz, n, dt);
+        }
+
+        float *w = interleaved.data();
+        for (long f = 0; f < n; ++f)
+            for (int c = 0; c < channels; ++c)
+                *w++ = source[c][f];
+
+        ok = (fwrite(interleaved.data(), sizeof(float) * channels, n, outfile) == static_cast<std::size_t>(n));
+    }
+
+    if (fclose(outfile) != 0 || !ok)
+    {
+        printf("ERROR: Failed writing output file: %s\n", out);
+        return;
+    }
+
+    auto finish = std::chrono::steady_clock::now();
+    job.elapsed = std::chrono::duration<double>(finish - start).count();
+    job.ok = true;
+    printf("%s: %ld frames in %0.3lf seconds, %0.1lfx real time, %0.1lf MB/s\n",
+        out, frames, job.elapsed, job.seconds / job.elapsed,
+        (4.0 * channels * frames) / (1.0e6 * job.elapsed));
+}
@@ -0,0 +1,170 @@
+/*
+    stepsearch.cpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Finds the largest stable time step of each kind of chaotic oscillator
+    (see StableStep.hpp), trying several candidate steps at once on all CPU cores.
+    Optionally saves a safe fraction of that step as max_dt in the kind's
+    range table file, where ChaoticOscillator::setRangeTable() picks it up.
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "MakeChaoticOscillator.hpp"
+#include "StableStep.hpp"
+
+struct SearchOptions
+{
+    Analog::StableStepOptions search;
+    double safety = 0.25;
+    bool save = false;
+};
+
+static int PrintUsage();
+static bool ParseArg(const char *arg, SearchOptions& options);
+
+int main(int argc, const char *argv[])
+{
+    using namespace Analog;
+
+    if (argc < 2)
+        return PrintUsage();
+
+    std::vector<const char *> kinds;
+    if (!strcmp(argv[1], "all"))
+    {
+        kinds = ChaoticOscillatorKinds;
+    }
+    else
+    {
+        if (MakeChaoticOscillator(argv[1]) == nullptr)
+        {
+            printf("ERROR: Unknown chaotic oscillator kind '%s'\n", argv[1]);
+            return 1;
+        }
+        kinds.push_back(argv[1]);
+    }
+
+    SearchOptions options;
+    for (int i = 2; i < argc; ++i)
+        if (!ParseArg(argv[i], options))
+            return 1;
+
+    for (const char *kind : kinds)
+    {
+        char filename[100];
+        RangeTableFileName(kind, filename, sizeof(filename));
+        std::optional<RangeTable> table = LoadRangeTable(filename, kind);
+
+        // Search with the ranges the oscillator will really use, but not with any saved max_dt.
+        auto factory = [kind, &table]()
+        {
+            auto osc = MakeChaoticOscillator(kind);
+            if (table)
+                osc->setRangeTable(*table);
+            return osc;
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        const StableStepResult result = FindStableStep(factory, options.search);
+        auto finish = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(finish - start).count();
+
+        printf("%-6s stable=%-12lg unstable=%-12lg max_dt=%-12lg trials=%d batches=%d seconds=%0.3lf\n",
+            kind, result.stable, result.unstable, MakeChaoticOscillator(kind)->maxStep(),
+            result.trials, result.batches, elapsed);
+
+        if (result.stable == 0.0)
+        {
+            printf("ERROR: %s is unstable even at et=%lg\n", kind, options.search.start);
+            return 1;
+        }
+
+        if (options.save)
+        {
+            if (!table)
+                table = RangeTable{};
+            table->maxStep = options.safety * result.stable;
+            if (!SaveRangeTable(filename, kind, *table, "stepsearch"))
+                return 1;
+            printf("Wrote max_dt=%lg to %s\n", table->maxStep, filename);
+        }
+    }
+    return 0;
+}
+
+
+static int PrintUsage()
+{
+    printf(
+        "USAGE: stepsearch kind [options...]\n"
+        "\n"
+        "Finds the largest time step that keeps an oscillator stable: within\n"
+        "AMPLITUDE+0.1 of the origin, and swinging through most of its usual range.\n"
+        "The kind may be 'all' to search every kind of oscillator:\n"
+    );
+    for (const char *kind : Analog::ChaoticOscillatorKinds)
+        printf("    %s\n", kind);
+    printf(
+        "\n"
+        "Options:\n"
+        "    steps=n       time steps simulated per trial (default 26460000)\n"
+        "    tolerance=f   stop when the bracket is narrower than this ratio (default 0.01)\n"
+        "    coverage=f    fraction of the usual swing each output must keep (default 0.9)\n"
+        "    threads=n     candidate steps tried at once (default: all cores)\n"
+        "    save          write safety*stable as max_dt to the range table kind.range\n"
+        "    safety=f      fraction of the stable step to save (default 0.25)\n"
+        "\n"
+        "A stable step is not necessarily an accurate one: the built-in max_dt\n"
+        "values were chosen for accuracy, and are often much smaller.\n"
+        "\n"
+    );
+    return 1;
+}
+
+
+static bool ParseArg(const char *arg, SearchOptions& options)
+{
+    if (!strcmp(arg, "save"))
+    {
+        options.save = true;
+        return true;
+    }
+
+    const char *eq = strchr(arg, '=');
+    if (eq == nullptr)
+    {
+        printf("ERROR: Invalid argument: %s\n", arg);
+        return false;
+    }
+
+    const std::string name(arg, eq - arg);
+    char *end = nullptr;
+    const double x = strtod(eq + 1, &end);
+    if (end == eq + 1 || *end != '\0' || !std::isfinite(x))
+    {
+        printf("ERROR: Invalid number in argument: %s\n", arg);
+        return false;
+    }
+
+    if (name == "steps" && x >= 1000)
+        options.search.steps = static_cast<long>(x);
+    else if (name == "tolerance" && x > 0)
+        options.search.tolerance = x;
+    else if (name == "coverage" && x >= 0 && x <= 1)
+        options.search.coverage = x;
+    else if (name == "threads" && x >= 1)
+        options.search.threads = static_cast<unsigned>(x);
+    else if (name == "safety" && x > 0 && x <= 1)
+        options.safety = x;
+    else
+    {
+        printf("ERROR: Invalid argument: %s\n", arg);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,361 @@
+/*
+    stream.cpp  -  Don Cross <cosinekitty@gmail.com>
+
+    Runs a chaotic oscillator as a filter in a shell pipeline: reads knob/CV
+    frames from stdin as raw 32-bit floats (one per frame) and writes
+    interleaved output frames to stdout as raw 32-bit floats, for example:
+
+        stream ruck < cv.f32 | sox -t f32 -c 3 -r 44100 - ruck.wav
+        stream aiza knob=0.3 seconds=60 channels=x | aplay -f FLOAT_LE -r 44100
+
+    All input and output goes through large buffers allocated once at startup,
+    with one read() and one write() per block. With the 'zerocopy' option and
+    stdout a pipe, the output is handed to the pipe with vmsplice() instead
+    of being copied by write(). That assumes the reader read()s the pipe:
+    a reader that splice()s or tee()s the pages elsewhere can keep them alive
+    after stream has reused the buffer, and then sees later output in them.
+
+    Errors go to stderr, because stdout carries the audio.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/uio.h>
+#endif
+#include "MakeChaoticOscillator.hpp"
+#include "StateCache.hpp"
+
+struct StreamOptions
+{
+    double rate = 44100;
+    double speed = 1.0;
+    double scale = 1.0;         // knob = scale * CV
+    double knob = 0.0;
+    bool fixedKnob = false;     // no CV input: hold the knob at `knob`
+    double seconds = 0.0;       // output duration with a fixed knob; 0 = until stdout closes
+    long block = 4096;
+    std::string channels = "xyz";
+    bool zerocopy = false;
+    bool warm = false;
+};
+
+static int PrintUsage();
+static bool ParseArg(const char *arg, StreamOptions& options);
+
+
+// Writes whole blocks to stdout, by write() or, on Linux pipes, by vmsplice().
+class OutputStream
+{
+private:
+    // vmsplice() lends our pages to the pipe instead of copying them, so a buffer
+    // must not be reused until the reader has consumed it. The pipe holds at most
+    // `pipeBytes`, so after that many more bytes have gone in behind a buffer,
+    // the buffer is free again. Sends can be shorter than a block, so count the
+    // bytes rather than the sends. The buffers are used in turn; when the next one
+    // is still lent to the pipe, the block goes through a spare buffer and write().
+    std::vector<std::vector<float>> buffers;    // in turn for vmsplice(), then the spare
+    std::vector<std::uint64_t> freeAt;          // `sent` at which each buffer is free again
+    std::uint64_t sent = 0;                     // bytes sent to stdout so far
+    std::uint64_t pipeBytes = 0;
+    std::size_t next = 0;                       // the buffer to use next for vmsplice()
+    std::size_t current = 0;                    // the buffer being filled
+    bool splice = false;
+
+    static bool writeAll(const char *data, std::size_t bytes)
+    {
+        while (bytes > 0)
+        {
+            const ssize_t n = write(STDOUT_FILENO, data, bytes);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            bytes -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+#if defined(__linux__)
+    static bool spliceAll(const char *data, std::size_t bytes)
+    {
+        while (bytes > 0)
+        {
+            iovec iov;
+            iov.iov_base = const_cast<char *>(data);
+            iov.iov_len = bytes;
+            const ssize_t n = vmsplice(STDOUT_FILENO, &iov, 1, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            bytes -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+#endif
+
+public:
+    OutputStream(std::size_t floatsPerBlock, bool zerocopy)
+    {
+        std::size_t count = 1;
+#if defined(__linux__)
+        struct stat st;
+        if (zerocopy && fstat(STDOUT_FILENO, &st) == 0 && S_ISFIFO(st.st_mode))
+        {
+            const int size = fcntl(STDOUT_FILENO, F_GETPIPE_SZ);
+            if (size > 0)
+            {
+                // Enough buffers that full blocks never have to wait, plus the spare.
+                pipeBytes = static_cast<std::uint64_t>(size);
+                const std::size_t blockBytes = floatsPerBlock * sizeof(float);
+                count = 3 + static_cast<std::size_t>(pipeBytes) / blockBytes;
+                splice = true;
+            }
+        }
+#else
+        (void)zerocopy;
+#endif
+        buffers.resize(count);
+        for (std::vector<float>& b : buffers)
+            b.resize(floatsPerBlock);
+        freeAt.resize(count);
+    }
+
+    bool usingSplice() const { return splice; }
+
+    // The buffer to fill next.
+    float *buffer() { return buffers[current].data(); }
+
+    bool send(std::size_t floats)
+    {
+        const char *data = reinterpret_cast<const char *>(buffers[current].data());
+        const std::size_t bytes = floats * sizeof(float);
+        const std::size_t spare = buffers.size() - 1;
+        bool ok;
+#if defined(__linux__)
+        if (splice && current != spare)
+        {
+            ok = spliceAll(data, bytes);
+            sent += bytes;
+            freeAt[current] = sent + pipeBytes;
+            next = (current + 1) % spare;
+        }
+        else
+#endif
+        {
+            ok = writeAll(data, bytes);
+            sent += bytes;
+        }
+        if (splice)
+            current = (sent >= freeAt[next]) ? next : spare;
+        return ok;
+    }
+};
+
+
+// Reads as many whole floats as are available, up to `max`, blocking only
+// when none are. Returns 0 at end of input (a trailing partial float is dropped).
+static std::size_t ReadFloats(float *data, std::size_t max)
+{
+    char *bytes = reinterpret_cast<char *>(data);
+    std::size_t have = 0;
+    while (have < sizeof(float) || have % sizeof(float) != 0)
+    {
+        const ssize_t n = read(STDIN_FILENO, bytes + have, max*sizeof(float) - have);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        have += static_cast<std::size_t>(n);
+    }
+    return have / sizeof(float);
+}
+
+
+int main(int argc, const char *argv[])
+{
+    using namespace Analog;
+
+    if (argc < 2)
+        return PrintUsage();
+
+    const char *kind = argv[1];
+    std::unique_ptr<ChaoticOscillator> osc = MakeChaoticOscillator(kind);
+    if (!osc)
+    {
+        fprintf(stderr, "ERROR: Unknown chaotic oscillator kind '%s'\n", kind);
+        return 1;
+    }
+
+    StreamOptions options;
+    for (int i = 2; i < argc; ++i)
+        if (!ParseArg(argv[i], options))
+            return 1;
+
+    LoadRangeTable(*osc, kind);
+    osc->setKnob(options.knob);
+    if (options.warm)
+        if (std::optional<StateCache> cache = LoadStateCache(kind))
+            WarmStart(*osc, *cache, std::random_device{}());
+
+    // A closed stdout should end the stream quietly, not kill it with SIGPIPE.
+    signal(SIGPIPE, SIG_IGN);
+
+    const std::size_t block = static_cast<std::size_t>(options.block);
+    const int channels = static_cast<int>(options.channels.size());
+    std::vector<float> knobIn(block);
+    std::vector<float> bx(block);
+    std::vector<float> by(block);
+    std::vector<float> bz(block);
+    const float *source[3];
+    for (int c = 0; c < channels; ++c)
+        source[c] = (options.channels[c] == 'x') ? bx.data() : (options.channels[c] == 'y') ? by.data() : bz.data();
+    float *px = (options.channels.find('x') != std::string::npos) ? bx.data() : nullptr;
+    float *py = (options.channels.find('y') != std::string::npos) ? by.data() : nullptr;
+    float *pz = (options.channels.find('z') != std::string::npos) ? bz.data() : nullptr;
+
+    OutputStream output(block * channels, options.zerocopy);
+    if (options.zerocopy && !output.usingSplice())
+        fprintf(stderr, "stream: stdout is not a pipe; using write() instead of vmsplice().\n");
+
+    const double dt = options.speed / options.rate;
+    const long total = static_cast<long>(std::llround(options.seconds * options.rate));
+    long produced = 0;
+    while (true)
+    {
+        std::size_t n;
+        if (options.fixedKnob)
+        {
+            n = block;
+            if (total > 0)
+                n = static_cast<std::size_t>(std::min(static_cast<long>(block), total - produced));
+            if (n == 0)
+                break;
+            osc->process(px, py, pz, n, dt);
+        }
+        else
+        {
+            n = ReadFloats(knobIn.data(), block);
+            if (n == 0)
+                break;
+            if (options.scale != 1.0)
+                for (std::size_t f = 0; f < n; ++f)
+                    knobIn[f] *= static_cast<float>(options.scale);
+            osc->process(px, py, pz, knobIn.data(), n, dt);
+        }
+
+        float *w = output.buffer();
+        for (std::size_t f = 0; f < n; ++f)
+            for (int c = 0; c < channels; ++c)
+                *w++ = source[c][f];
+
+        if (!output.send(n * channels))
+            break;      // the reader went away
+        produced += static_cast<long>(n);
+    }
+    return 0;
+}
+
+
+static int PrintUsage()
+{
+    fprintf(stderr,
+        "USAGE: stream kind [options...]\n"
+        "\n"
+        "Reads knob/CV frames from stdin as raw 32-bit floats, one per frame,\n"
+        "and writes interleaved output frames to stdout as raw 32-bit floats.\n"
+        "The kind is one of:");
+    for (const char *kind : Analog::ChaoticOscillatorKinds)
+        fprintf(stderr, " %s", kind);
+    fprintf(stderr,
+        "\n\n"
+        "Options:\n"
+        "    rate=hz        sample rate (default 44100)\n"
+        "    speed=f        oscillator seconds per output second (default 1)\n"
+        "    scale=f        knob = scale * input value, clamped to [-1, +1] (default 1)\n"
+        "    knob=v         ignore stdin and hold the knob at v\n"
+        "    seconds=s      with knob=v, stop after s seconds (default: until stdout closes)\n"
+        "    channels=xyz   which outputs to write, in order (default xyz)\n"
+        "    block=n        frames per block (default 4096)\n"
+        "    zerocopy       hand output to a pipe with vmsplice() (Linux)\n"
+        "    warm           start at a random state from kind.states (see calibrate)\n"
+        "\n");
+    return 1;
+}
+
+
+static bool ParseArg(const char *arg, StreamOptions& options)
+{
+    if (!strcmp(arg, "zerocopy"))
+    {
+        options.zerocopy = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "warm"))
+    {
+        options.warm = true;
+        return true;
+    }
+
+    const char *eq = strchr(arg, '=');
+    if (eq != nullptr)
+    {
+        const std::string name(arg, eq - arg);
+        const char *value = eq + 1;
+
+        if (name == "channels")
+        {
+            options.channels = value;
+            bool ok = !options.channels.empty() && options.channels.size() <= 3;
+            for (char c : options.channels)
+                ok = ok && (c == 'x' || c == 'y' || c == 'z');
+            if (ok)
+                return true;
+        }
+        else
+        {
+            char *end;
+            const double x = strtod(value, &end);
+            if (end != value && *end == '\0' && std::isfinite(x))
+            {
+                if (name == "rate" && x >= 1.0)
+                    options.rate = x;
+                else if (name == "speed" && x > 0.0)
+                    options.speed = x;
+                else if (name == "scale")
+                    options.scale = x;
+                else if (name == "knob" && x >= -1.0 && x <= +1.0)
+                    options.knob = x, options.fixedKnob = true;
+                else if (name == "seconds" && x >= 0.0)
+                    options.seconds = x;
+                else if (name == "block" && x >= 1.0 && x <= 1048576.0)
+                    options.block = static_cast<long>(x);
+                else
+                    goto fail;
+                return true;
+            }
+        }
+    }
+
+fail:
+    fprintf(stderr, "ERROR: Invalid argument: %s\n", arg);
+    return false;
+}